@@ -0,0 +1,333 @@
+#include <QCoreApplication>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <KComponentData>
+
+#include <sqlite3.h>
+
+#include <string>
+
+#include "databaseworker.h"
+#include "importtask.h"
+#include "libraryindex.h"
+#include "loadlibrarytask.h"
+#include "searchworker.h"
+#include "shufflebag.h"
+#include "trackwriter.h"
+
+/*
+ * projekt7-bench [tracks ...]
+ * Builds a synthetic library of each size (10k, 100k and 1M tracks by default) in a scratch database with the
+ * player's own schema, then times the operations behind the browse columns, playback order and search, imports
+ * directories of generated MP3 files into it the way the player does, and prints latency percentiles for each.
+ * Needs no display, everything it runs is in the projekt7core library.
+ */
+
+typedef QVector<qint64> Samples; //NOTE: nanoseconds, one per run
+
+const char *SYLLABLES[] = {"ka", "lo", "mi", "ra", "den", "vor", "tes", "qua", "bel", "zin", "or", "ha", "pu", "strom", "eli", "nax", "tu", "sen", "gar", "fi"};
+const int NUM_SYLLABLES = sizeof(SYLLABLES) / sizeof(*SYLLABLES);
+const int IMPORT_FILES = 200; //NOTE: files in each imported directory
+const int MPEG_FRAME = 417; //NOTE: MPEG-1 layer III at 128 kbps and 44.1 kHz, unpadded
+
+static quint32 random_state; //NOTE: seeded by bench(), so every size builds the same library whatever ran before it
+
+static int randomInt(int range) {
+	random_state = random_state * 1103515245 + 12345;
+	return (random_state >> 8) % range;
+}
+
+static QString words(int min, int max) {
+	QStringList text;
+	for (int count = min + randomInt(max - min + 1); count > 0; --count) {
+		QString word;
+		for (int syllables = 2 + randomInt(2); syllables > 0; --syllables)
+			word += SYLLABLES[randomInt(NUM_SYLLABLES)];
+		word[0] = word.at(0).toUpper();
+		text.push_back(word);
+	}
+	return text.join(" ");
+}
+
+static void report(QTextStream &out, const char *name, Samples samples) {
+	if (samples.isEmpty())
+		return;
+	qSort(samples);
+	int last = samples.count() - 1;
+	out << qSetFieldWidth(28) << left << name << qSetFieldWidth(10) << right << samples.count()
+	    << samples.at(last * 50 / 100) / 1000.0 << samples.at(last * 90 / 100) / 1000.0 << samples.at(last * 99 / 100) / 1000.0 << samples.at(last) / 1000.0
+	    << qSetFieldWidth(0) << endl;
+}
+
+//NOTE: most artists have an album or two, a few have a long discography, albums run 6 to 17 tracks
+static bool generateLibrary(TrackWriter &writer, int num_tracks, Samples &samples) {
+	QElapsedTimer timer;
+	TrackInfo track;
+	track.length = 0;
+	track.stamp.size = 0;
+	track.stamp.mtime = 0;
+	for (int artist = 0, written = 0; written < num_tracks; ++artist) {
+		track.artist = words(1, 2);
+		int num_albums = randomInt(100) < 80 ? 1 + randomInt(2) : 3 + randomInt(15);
+		for (int album = 0; album < num_albums && written < num_tracks; ++album) {
+			track.album = words(1, 3);
+			track.year = 1960 + randomInt(60);
+			int album_tracks = 6 + randomInt(12);
+			for (int number = 1; number <= album_tracks && written < num_tracks; ++number, ++written) {
+				track.track_number = number;
+				track.title = words(1, 4);
+				track.length = 120 + randomInt(360);
+				track.path = QString("/bench/%1/%2/%3.mp3").arg(artist).arg(album).arg(number);
+				timer.start();
+				if (!writer.write(track))
+					return false;
+				samples.push_back(timer.nsecsElapsed());
+			}
+		}
+	}
+	return writer.commit();
+}
+
+static QByteArray id3Text(const char *id, const QString &text) { //NOTE: an ID3v2.3 frame, latin-1
+	QByteArray body = QByteArray(1, 0) + text.toLatin1();
+	QByteArray frame(id);
+	for (int shift = 24; shift >= 0; shift -= 8)
+		frame += (char)((body.size() >> shift) & 0xFF);
+	return frame + QByteArray(2, 0) + body;
+}
+
+//NOTE: ten albums of tracks with an ID3v2.3 tag and a second of MPEG frames, what TagParser reads without TagLib
+static bool writeImportFiles(const QString &dir, QStringList &paths) {
+	if (!QDir().mkpath(dir))
+		return false;
+	QByteArray frame("\xFF\xFB\x90\x44", 4);
+	frame += QByteArray(MPEG_FRAME - frame.size(), 0);
+	QByteArray audio;
+	for (int i = 0; i < 38; ++i)
+		audio += frame;
+	QString artist, album, year;
+	for (int number = 0; number < IMPORT_FILES; ++number) {
+		if (number % (IMPORT_FILES / 10) == 0) {
+			artist = words(1, 2);
+			album = words(1, 3);
+			year = QString::number(1960 + randomInt(60));
+		}
+		QByteArray frames = id3Text("TPE1", artist) + id3Text("TALB", album) + id3Text("TYER", year) + id3Text("TRCK", QString::number(number % (IMPORT_FILES / 10) + 1)) + id3Text("TIT2", words(1, 4));
+		QByteArray data("ID3\x03\x00\x00", 6);
+		for (int shift = 21; shift >= 0; shift -= 7)
+			data += (char)((frames.size() >> shift) & 0x7F);
+		data += frames + audio;
+		QString path = QDir(dir).filePath(QString("%1.mp3").arg(number));
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly) || file.write(data) != data.size())
+			return false;
+		paths.push_back(path);
+	}
+	return true;
+}
+
+static bool pageAllTitles(sqlite3 *db) {
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `tid`, `title` FROM `tracks` ORDER BY `title` COLLATE NOCASE", -1, &stmt, 0))
+		return false;
+	int rows = 0, return_code;
+	while (rows < 256 && (return_code = sqlite3_step(stmt)) == SQLITE_ROW) //NOTE: one BrowseModel page
+		++rows;
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_ROW || return_code == SQLITE_DONE;
+}
+
+//NOTE: as the SearchWorker steps it, the first page of 1000 matches is handed back before the rest
+static bool search(sqlite3_stmt *stmt, const QString &text, QElapsedTimer &timer, Samples &first_pages) {
+	std::string match = SearchWorker::matchExpression(text).toStdString();
+	sqlite3_bind_text(stmt, 1, match.c_str(), match.size(), SQLITE_TRANSIENT);
+	int return_code, matches = 0;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		if (++matches == 1000)
+			first_pages.push_back(timer.nsecsElapsed());
+	}
+	if (matches < 1000)
+		first_pages.push_back(timer.nsecsElapsed());
+	sqlite3_reset(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+static void removeDatabase(const QString &path) {
+	QFile::remove(path);
+	QFile::remove(path + "-wal");
+	QFile::remove(path + "-shm");
+}
+
+static bool bench(QTextStream &out, int num_tracks) {
+	random_state = 7;
+	QString db_path = QDir::temp().filePath(QString("projekt7-bench-%1.db").arg(QCoreApplication::applicationPid()));
+	QString snapshot_path = db_path + ".snapshot";
+	removeDatabase(db_path);
+	sqlite3 *db = 0;
+	QString failure_msg;
+	if (!DatabaseWorker::openDatabase(db_path, &db, failure_msg)) {
+		out << failure_msg << sqlite3_errmsg(db) << endl;
+		sqlite3_close(db);
+		return false;
+	}
+	QElapsedTimer timer;
+	Samples write, load, snapshot_write, snapshot_read, artists, albums, titles, all_titles, next, bag_load, shuffle, search_pages, searches;
+	bool ok;
+	{
+		TrackWriter writer(db);
+		ok = generateLibrary(writer, num_tracks, write);
+	}
+	LibraryIndex library;
+	for (int run = 0; run < 5 && ok; ++run) {
+		timer.start();
+		ok = library.load(db);
+		load.push_back(timer.nsecsElapsed());
+	}
+	for (int run = 0; run < 5 && ok; ++run) {
+		timer.start();
+		ok = library.writeSnapshot(snapshot_path, run);
+		snapshot_write.push_back(timer.nsecsElapsed());
+		LibraryIndex mapped;
+		qint64 generation;
+		timer.start();
+		ok = ok && mapped.readSnapshot(snapshot_path, generation) && mapped.count() == library.count();
+		snapshot_read.push_back(timer.nsecsElapsed());
+	}
+	QVector<int> ids;
+	QStringList texts;
+	for (int run = 0; run < 100 && ok; ++run) {
+		ids.clear();
+		texts.clear();
+		timer.start();
+		library.artists(ids, texts);
+		artists.push_back(timer.nsecsElapsed());
+	}
+	int num_albums = library.count() > 0 ? library.albumOf(library.count() - 1) + 1 : 0;
+	for (int run = 0; run < 10000 && ok && num_albums > 0; ++run) {
+		int artist = randomInt(library.numArtists());
+		int album = randomInt(num_albums);
+		ids.clear();
+		texts.clear();
+		timer.start();
+		library.albums(artist, ids, texts);
+		albums.push_back(timer.nsecsElapsed());
+		ids.clear();
+		texts.clear();
+		timer.start();
+		library.tracks(album, ids, texts);
+		titles.push_back(timer.nsecsElapsed());
+	}
+	for (int run = 0; run < 20 && ok; ++run) {
+		timer.start();
+		ok = pageAllTitles(db);
+		all_titles.push_back(timer.nsecsElapsed());
+	}
+	int tid = library.count() > 0 ? library.tid(0) : 0;
+	for (int run = 0; run < 100000 && ok && tid; ++run) {
+		timer.start();
+		tid = library.following(tid);
+		next.push_back(timer.nsecsElapsed());
+	}
+	ShuffleBag bag; //NOTE: without a worker, draws aren't written back
+	for (int run = 0; run < 5 && ok; ++run) {
+		timer.start();
+		ok = bag.load(db);
+		bag_load.push_back(timer.nsecsElapsed());
+	}
+	for (int run = 0; run < 100000 && ok && library.count() > 0; ++run) {
+		timer.start();
+		bag.next();
+		shuffle.push_back(timer.nsecsElapsed());
+	}
+	sqlite3_stmt *search_stmt = 0;
+	ok = ok && !sqlite3_prepare_v2(db, "SELECT `rowid` FROM `tracks_search` WHERE `tracks_search` MATCH ?", -1, &search_stmt, 0);
+	for (int run = 0; run < 200 && ok; ++run) {
+		QString text = QString(SYLLABLES[randomInt(NUM_SYLLABLES)]) + (run % 2 ? " " + QString(SYLLABLES[randomInt(NUM_SYLLABLES)]) : QString());
+		timer.start();
+		ok = search(search_stmt, text, timer, search_pages);
+		searches.push_back(timer.nsecsElapsed());
+	}
+	sqlite3_finalize(search_stmt);
+	//NOTE: last, so the library the other operations ran on is the generated one
+	QString import_dir = db_path + ".import";
+	QStringList import_paths;
+	Samples imports, rescans, reloads;
+	for (int run = 0; run < 5 && ok; ++run) {
+		QString dir = QString("%1/%2").arg(import_dir).arg(run);
+		ok = writeImportFiles(dir, import_paths);
+		ImportTask import;
+		import.scan_dir = import.stamp_dir = dir;
+		timer.start();
+		ok = ok && import.run(db) && import.inserted == IMPORT_FILES;
+		imports.push_back(timer.nsecsElapsed());
+		ImportTask rescan;
+		rescan.scan_dir = rescan.stamp_dir = dir;
+		timer.start();
+		ok = ok && rescan.run(db) && rescan.unchanged == IMPORT_FILES;
+		rescans.push_back(timer.nsecsElapsed());
+		LoadLibraryTask reload(0, snapshot_path, LoadLibraryTask::CurrentTrack);
+		reload.previous = library;
+		timer.start();
+		ok = ok && reload.run(db);
+		reloads.push_back(timer.nsecsElapsed());
+		library = reload.library;
+	}
+	if (!ok)
+		out << "Failed: " << sqlite3_errmsg(db) << endl;
+	out << num_tracks << " tracks, " << library.numArtists() << " artists, " << num_albums << " albums" << endl;
+	out << qSetFieldWidth(28) << left << "operation" << qSetFieldWidth(10) << right << "runs" << "p50 us" << "p90 us" << "p99 us" << "max us" << qSetFieldWidth(0) << endl;
+	report(out, "write track", write);
+	report(out, "load library index", load);
+	report(out, "write snapshot", snapshot_write);
+	report(out, "read snapshot", snapshot_read);
+	report(out, "artist column", artists);
+	report(out, "album column", albums);
+	report(out, "titles column", titles);
+	report(out, "[All] titles first page", all_titles);
+	report(out, "next track", next);
+	report(out, "load shuffle bag", bag_load);
+	report(out, "shuffle next", shuffle);
+	report(out, "search first page", search_pages);
+	report(out, "search every match", searches);
+	report(out, "import 200 files", imports);
+	report(out, "rescan 200 files", rescans);
+	report(out, "reload after import", reloads);
+	out << endl;
+	sqlite3_close(db);
+	removeDatabase(db_path);
+	QFile::remove(snapshot_path);
+	QString path;
+	foreach(path, import_paths)
+		QFile::remove(path);
+	for (int run = 4; run >= 0; --run)
+		QDir().rmdir(QString("%1/%2").arg(import_dir).arg(run));
+	QDir().rmdir(import_dir);
+	return ok;
+}
+
+int main(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	KComponentData component("projekt7-bench");
+	QList<int> sizes;
+	QStringList args = app.arguments().mid(1);
+	QString arg;
+	foreach(arg, args)
+		sizes.push_back(arg.toInt());
+	if (sizes.isEmpty())
+		sizes << 10000 << 100000 << 1000000;
+	QTextStream out(stdout);
+	out.setRealNumberNotation(QTextStream::FixedNotation);
+	out.setRealNumberPrecision(1);
+	int size;
+	foreach(size, sizes) {
+		if (size > 0 && !bench(out, size))
+			return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "browsemodel.h"
+#include "profiler.h"
+
+const int PAGE_SIZE = 256;
+
+/*
+ * Steps the next page of a browse query, preparing the statement first for the first page.
+ */
+class PageTask : public DatabaseTask
+{
+	public:
+		PageTask(const QString &, sqlite3_stmt *, const QByteArray &, int);
+		
+		bool run(sqlite3 *);
+		
+		sqlite3_stmt *stmt; //NOTE: 0 once the last row has been stepped
+		QByteArray query;
+		int generation;
+		QVector<int> ids;
+		QStringList texts;
+};
+
+/*
+ * Finalizes a browse query that was closed before its last page was fetched.
+ */
+class FinalizeTask : public DatabaseTask
+{
+	public:
+		FinalizeTask(sqlite3_stmt *);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		sqlite3_stmt *stmt;
+};
+
+PageTask::PageTask(const QString &failure_msg, sqlite3_stmt *stmt, const QByteArray &query, int generation) : DatabaseTask(failure_msg), stmt(stmt), query(query), generation(generation) {
+}
+
+bool PageTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	if (!stmt && sqlite3_prepare_v2(db, query.constData(), -1, &stmt, 0))
+		return false;
+	int return_code = SQLITE_ROW;
+	while (ids.count() < PAGE_SIZE && (return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		ids.push_back(sqlite3_column_int(stmt, 0));
+		texts.push_back(QString((const char *)sqlite3_column_text(stmt, 1))); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
+	}
+	if (return_code != SQLITE_ROW) {
+		sqlite3_finalize(stmt);
+		stmt = 0;
+	}
+	return return_code == SQLITE_ROW || return_code == SQLITE_DONE;
+}
+
+FinalizeTask::FinalizeTask(sqlite3_stmt *stmt) : DatabaseTask(QString()), stmt(stmt) {
+}
+
+bool FinalizeTask::run(sqlite3 *) {
+	sqlite3_finalize(stmt);
+	return true;
+}
+
+BrowseModel::BrowseModel(DatabaseWorker *database, const char *column, const QString &all_text, QObject *parent) : QAbstractListModel(parent), database(database), stmt(0), all_text(all_text), queued_tracks(0), covers(0), generation(0), fetching(false), more(false) {
+	failure_msg = QString("Failed to Step %1 in GUI update: ").arg(column);
+	fill_label = QString("Fill %1 column").arg(column);
+}
+
+BrowseModel::~BrowseModel() {
+	close();
+}
+
+void BrowseModel::setQuery(char *query) {
+	ProfileSpan span(fill_label);
+	beginResetModel();
+	close();
+	clearRows();
+	fetchPage(query);
+	sqlite3_free(query);
+	endResetModel();
+}
+
+void BrowseModel::setRows(const QVector<int> &ids, const QStringList &texts) {
+	ProfileSpan span(fill_label);
+	beginResetModel();
+	close();
+	clearRows();
+	rows.reserve(ids.count() + 1);
+	id_rows.reserve(ids.count() + 1);
+	for (int i = 0; i < ids.count(); ++i)
+		appendRow(ids.at(i), texts.at(i));
+	endResetModel();
+}
+
+void BrowseModel::mergeRows(const QVector<int> &ids, const QStringList &texts) {
+	ProfileSpan span(fill_label);
+	close();
+	QVector<Row> merged;
+	QHash<int, int> merged_rows; //NOTE: `id` -> its row once merged
+	merged.reserve(ids.count() + 1);
+	merged_rows.reserve(ids.count() + 1);
+	if (!all_text.isEmpty()) {
+		Row all = {0, all_text};
+		merged.push_back(all);
+		merged_rows.insert(0, 0);
+	}
+	for (int i = 0; i < ids.count(); ++i) {
+		Row row = {ids.at(i), texts.at(i)};
+		merged_rows.insert(row.id, merged.count());
+		merged.push_back(row);
+	}
+	emit layoutAboutToBeChanged(); //NOTE: one relayout for every row that comes and goes, however they interleave
+	QModelIndexList old_indexes = persistentIndexList(), new_indexes;
+	QVector<int> new_rows; //NOTE: where each persistent index goes, -1 when its row is gone
+	new_rows.reserve(old_indexes.count());
+	QModelIndex old_index;
+	foreach(old_index, old_indexes)
+		new_rows.push_back(old_index.row() < rows.count() ? merged_rows.value(rows.at(old_index.row()).id, -1) : -1);
+	rows = merged;
+	id_rows = merged_rows;
+	int new_row;
+	foreach(new_row, new_rows)
+		new_indexes.push_back(new_row == -1 ? QModelIndex() : index(new_row));
+	changePersistentIndexList(old_indexes, new_indexes);
+	emit layoutChanged();
+}
+
+void BrowseModel::close() {
+	if (stmt)
+		database->post(new FinalizeTask(stmt));
+	stmt = 0;
+	++generation; //NOTE: a page on its way belongs to the closed query, its statement is finalized when it arrives
+	fetching = false;
+	more = false;
+}
+
+void BrowseModel::setQueuedIcon(const TrackQueue *tracks, const QIcon &icon) {
+	queued_tracks = tracks;
+	queued_icon = icon;
+}
+
+void BrowseModel::setCovers(CoverCache *cache) {
+	covers = cache;
+	blank_cover = QPixmap(CoverCache::Small, CoverCache::Small);
+	blank_cover.fill(Qt::transparent);
+}
+
+void BrowseModel::updateId(int id) {
+	int row = id_rows.value(id, -1);
+	if (row != -1)
+		emit dataChanged(index(row), index(row));
+}
+
+void BrowseModel::updateDecorations() {
+	if (rows.count() > 0)
+		emit dataChanged(index(0), index(rows.count() - 1));
+}
+
+int BrowseModel::id(int row) const {
+	return row >= 0 && row < rows.count() ? rows.at(row).id : 0;
+}
+
+int BrowseModel::row(int id) const {
+	return id_rows.value(id, -1);
+}
+
+QString BrowseModel::text(int row) const {
+	return row >= 0 && row < rows.count() ? rows.at(row).text : QString();
+}
+
+bool BrowseModel::hasRow(int row) const {
+	return row >= 0 && row < rows.count();
+}
+
+bool BrowseModel::atEnd() const {
+	return !fetching && !more;
+}
+
+int BrowseModel::rowCount(const QModelIndex &parent) const {
+	return parent.isValid() ? 0 : rows.count();
+}
+
+QVariant BrowseModel::data(const QModelIndex &index, int role) const {
+	if (!index.isValid() || index.row() >= rows.count())
+		return QVariant();
+	switch (role) {
+		case Qt::DisplayRole:
+			return rows.at(index.row()).text;
+		case Qt::UserRole:
+			return rows.at(index.row()).id;
+		case Qt::DecorationRole:
+			if (queued_tracks && queued_tracks->contains(rows.at(index.row()).id)) //NOTE: a set lookup, asked for every row the view paints
+				return queued_icon;
+			if (covers) { //NOTE: a cache lookup, the cover is read in the background the first time it is asked for
+				QPixmap cover = covers->cover(rows.at(index.row()).id, CoverCache::Small);
+				return cover.isNull() ? blank_cover : cover;
+			}
+			return QVariant();
+		default:
+			return QVariant();
+	}
+}
+
+bool BrowseModel::canFetchMore(const QModelIndex &parent) const {
+	return !parent.isValid() && more && !fetching; //NOTE: the view asks again once the page on its way has been inserted
+}
+
+void BrowseModel::fetchMore(const QModelIndex &parent) {
+	if (!parent.isValid() && more && !fetching)
+		fetchPage();
+}
+
+void BrowseModel::fetchPage(const QByteArray &query) {
+	fetching = true;
+	database->post(new PageTask(failure_msg, stmt, query, generation), this, "pageFetched");
+	stmt = 0; //NOTE: the task has the statement until the page comes back
+}
+
+void BrowseModel::pageFetched(DatabaseTask *task) {
+	PageTask *page = static_cast<PageTask *>(task);
+	if (page->generation != generation) {
+		if (page->stmt)
+			database->post(new FinalizeTask(page->stmt));
+		return;
+	}
+	stmt = page->stmt;
+	fetching = false;
+	more = stmt != 0;
+	if (!page->ids.isEmpty()) {
+		ProfileSpan span(fill_label);
+		beginInsertRows(QModelIndex(), rows.count(), rows.count() + page->ids.count() - 1); //NOTE: appended for good, nothing scrolled past is evicted
+		for (int i = 0; i < page->ids.count(); ++i)
+			appendRow(page->ids.at(i), page->texts.at(i));
+		endInsertRows();
+	}
+	emit rowsFetched();
+}
+
+void BrowseModel::clearRows() {
+	rows.clear();
+	id_rows.clear();
+	if (!all_text.isEmpty())
+		appendRow(0, all_text);
+}
+
+void BrowseModel::appendRow(int id, const QString &text) {
+	if (!id_rows.contains(id))
+		id_rows.insert(id, rows.count());
+	Row row = {id, text};
+	rows.push_back(row);
+}
@@ -0,0 +1,89 @@
+#ifndef _BROWSEMODEL_H_
+#define _BROWSEMODEL_H_
+
+#include <QAbstractListModel>
+#include <QHash>
+#include <QIcon>
+#include <QList>
+#include <QPixmap>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <sqlite3.h>
+
+#include "covercache.h"
+#include "databaseworker.h"
+#include "trackqueue.h"
+
+/*
+ * One column of the browser (artists, albums or titles).  The query's rows, (`id`, `text`) pairs, are
+ * stepped a page at a time as the view scrolls (canFetchMore/fetchMore) from a statement that stays open,
+ * so showing a 100k row column only materializes the rows that have been scrolled into view.  The statement
+ * lives on the DatabaseWorker thread, pages are requested from there and inserted when they arrive.  Pages
+ * are never evicted, a fetched row is kept until the query is replaced: only the [All] albums and titles are
+ * paged, so the most a column holds is one row per track, and the LibraryIndex already holds every track.
+ * Columns that come straight from the LibraryIndex are set with setRows instead.  Every row that comes in is
+ * also indexed by its `id`, so finding the row of a track, album or artist never walks the column.  A column
+ * whose rows change a little at a time, like the artists after an import, is refilled with mergeRows, which
+ * builds the new rows in one pass and moves the view's persistent indexes to them by `id` in a single layout
+ * change, so the rows that are still there keep their selection and the view its scroll position.
+ * The albums column shows the cover of each album from a CoverCache, which never makes the view wait.
+ */
+class BrowseModel : public QAbstractListModel
+{
+	Q_OBJECT
+	
+	public:
+		BrowseModel(DatabaseWorker *, const char *, const QString & = QString(), QObject *parent = 0);
+		~BrowseModel();
+		
+		void setQuery(char *);
+		void setRows(const QVector<int> &, const QStringList &);
+		void mergeRows(const QVector<int> &, const QStringList &); //NOTE: `id`s must be unique, as artists are
+		void close();
+		void setQueuedIcon(const TrackQueue *, const QIcon &);
+		void setCovers(CoverCache *);
+		void updateId(int);
+		void updateDecorations();
+		int id(int) const;
+		int row(int) const; //NOTE: -1 when the `id` hasn't been fetched
+		QString text(int) const;
+		bool hasRow(int) const;
+		bool atEnd() const; //NOTE: every row of the query has been fetched
+		
+		int rowCount(const QModelIndex &parent = QModelIndex()) const;
+		QVariant data(const QModelIndex &, int) const;
+		bool canFetchMore(const QModelIndex &) const;
+		void fetchMore(const QModelIndex &);
+	
+	signals:
+		void rowsFetched();
+	
+	private slots:
+		void pageFetched(DatabaseTask *);
+	
+	private:
+		struct Row {
+			int id;
+			QString text;
+		};
+		
+		void fetchPage(const QByteArray & = QByteArray());
+		void clearRows();
+		void appendRow(int, const QString &);
+		
+		DatabaseWorker *database;
+		sqlite3_stmt *stmt; //NOTE: only ever stepped and finalized on the worker thread
+		QString all_text, failure_msg, fill_label; //NOTE: `fill_label` names the profile span of a repopulation
+		QVector<Row> rows;
+		QHash<int, int> id_rows; //NOTE: `id` -> its first row, the albums listed by name under [All] all have `id` 0
+		const TrackQueue *queued_tracks;
+		QIcon queued_icon;
+		CoverCache *covers;
+		QPixmap blank_cover; //NOTE: shown until a cover has been read and for albums without one, so every row is as tall
+		int generation; //NOTE: counts queries, a page of a query that has been replaced since it was requested is dropped
+		bool fetching, more;
+};
+
+#endif
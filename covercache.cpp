@@ -0,0 +1,348 @@
+#include "covercache.h"
+#include "profiler.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QStringList>
+
+#include <taglib/attachedpictureframe.h>
+#include <taglib/flacfile.h>
+#include <taglib/flacpicture.h>
+#include <taglib/id3v2tag.h>
+#include <taglib/mp4file.h>
+#include <taglib/mpegfile.h>
+#include <taglib/vorbisfile.h>
+#include <taglib/xiphcomment.h>
+
+const int COVER_SIZES[] = {CoverCache::Small, CoverCache::Large};
+const int NUM_COVER_SIZES = sizeof(COVER_SIZES) / sizeof(*COVER_SIZES);
+const char *COVER_NAMES[] = {"cover", "folder", "front", "albumart"}; //NOTE: the images in an album's directory taken as its cover, by the start of their name, best first
+const int NUM_COVER_NAMES = sizeof(COVER_NAMES) / sizeof(*COVER_NAMES);
+const int THUMBNAIL_QUALITY = 90;
+
+/*
+ * Reads the art recorded for every album.
+ */
+class CoversTask : public DatabaseTask
+{
+	public:
+		CoversTask();
+		
+		bool run(sqlite3 *);
+		
+		QHash<int, QByteArray> hashes;
+};
+
+/*
+ * Records the art found for a batch of albums.
+ */
+class CoverWriteTask : public DatabaseTask
+{
+	public:
+		CoverWriteTask(const QList<QPair<int, QByteArray> > &);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QList<QPair<int, QByteArray> > covers;
+};
+
+CoversTask::CoversTask() : DatabaseTask("Failed to read the album covers: ") {
+}
+
+bool CoversTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `album_id`, `hash` FROM `album_covers`", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW)
+		hashes.insert(sqlite3_column_int(stmt, 0), QByteArray((const char *)sqlite3_column_text(stmt, 1)));
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+CoverWriteTask::CoverWriteTask(const QList<QPair<int, QByteArray> > &covers) : DatabaseTask("Failed to write the album covers: "), covers(covers) {
+}
+
+bool CoverWriteTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "INSERT OR REPLACE INTO `album_covers` (`album_id`, `hash`) SELECT ?1, ?2 WHERE EXISTS (SELECT 1 FROM `albums` WHERE `alid`=?1)", -1, &stmt, 0)) //NOTE: an album deleted while its art was read stays out
+		return false;
+	if (!exec(db, "BEGIN")) {
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	int return_code = SQLITE_DONE;
+	for (int i = 0; i < covers.count() && return_code == SQLITE_DONE; ++i) {
+		sqlite3_bind_int(stmt, 1, covers.at(i).first);
+		sqlite3_bind_text(stmt, 2, covers.at(i).second.constData(), covers.at(i).second.size(), SQLITE_TRANSIENT);
+		return_code = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_DONE) {
+		exec(db, "ROLLBACK");
+		return false;
+	}
+	return exec(db, "COMMIT");
+}
+
+static QByteArray toByteArray(const TagLib::ByteVector &data) {
+	return QByteArray(data.data(), data.size());
+}
+
+static QByteArray readAttachedPicture(TagLib::ID3v2::Tag *tag) {
+	if (!tag)
+		return QByteArray();
+	const TagLib::ID3v2::FrameList &frames = tag->frameList("APIC");
+	TagLib::ID3v2::AttachedPictureFrame *cover = 0;
+	for (TagLib::ID3v2::FrameList::ConstIterator itt = frames.begin(); itt != frames.end(); ++itt) {
+		TagLib::ID3v2::AttachedPictureFrame *picture = static_cast<TagLib::ID3v2::AttachedPictureFrame *>(*itt);
+		if (!cover || (picture->type() == TagLib::ID3v2::AttachedPictureFrame::FrontCover && cover->type() != TagLib::ID3v2::AttachedPictureFrame::FrontCover))
+			cover = picture; //NOTE: the front cover, or the first picture when there is none
+	}
+	return cover ? toByteArray(cover->picture()) : QByteArray();
+}
+
+static QByteArray readFlacPicture(const TagLib::List<TagLib::FLAC::Picture *> &pictures) {
+	TagLib::FLAC::Picture *cover = 0;
+	for (TagLib::List<TagLib::FLAC::Picture *>::ConstIterator itt = pictures.begin(); itt != pictures.end(); ++itt) {
+		if (!cover || ((*itt)->type() == TagLib::FLAC::Picture::FrontCover && cover->type() != TagLib::FLAC::Picture::FrontCover))
+			cover = *itt;
+	}
+	return cover ? toByteArray(cover->data()) : QByteArray();
+}
+
+CoverCache::CoverCache(DatabaseWorker *database, const LibraryIndex *library, const QString &cache_dir, int memory_size, QObject *parent) : QThread(parent), database(database), library(library), cache_dir(cache_dir), pixmaps(qMax(memory_size, 1)), loaded(false), stopped(false) {
+}
+
+CoverCache::~CoverCache() {
+	stop();
+	wait();
+}
+
+void CoverCache::load() {
+	database->post(new CoversTask, this, "coversRead");
+}
+
+void CoverCache::stop() {
+	QMutexLocker lock(&mutex);
+	stopped = true;
+	wake.wakeAll();
+}
+
+QPixmap CoverCache::cover(int alid, Size size) {
+	CoverKey key(alid, size);
+	QPixmap *pixmap = pixmaps.object(key); //NOTE: makes it the most recently used
+	if (pixmap)
+		return *pixmap;
+	if (!loaded || requested.contains(key))
+		return QPixmap();
+	QHash<int, QByteArray>::const_iterator hash = hashes.constFind(alid);
+	if (hash != hashes.constEnd() && hash->isEmpty()) //NOTE: the album has no art
+		return QPixmap();
+	int album = library->albumIndex(alid);
+	if (album < 0)
+		return QPixmap();
+	CoverRequest request;
+	request.key = key;
+	request.path = library->path(library->firstTrack(album));
+	if (hash != hashes.constEnd())
+		request.hash = *hash;
+	requested.insert(key);
+	QMutexLocker lock(&mutex);
+	requests.push_back(request);
+	wake.wakeOne();
+	return QPixmap();
+}
+
+void CoverCache::run() {
+	CoverRequest request;
+	while (takeRequest(request)) {
+		CoverImage image;
+		image.key = request.key;
+		image.image = readCover(request, image.hash, image.extracted);
+		QMutexLocker lock(&mutex);
+		images.push_back(image);
+		if (images.count() == 1) //NOTE: one deliver() takes whatever has been read by the time the GUI gets to it
+			QMetaObject::invokeMethod(this, "deliver", Qt::QueuedConnection);
+	}
+}
+
+void CoverCache::coversRead(DatabaseTask *task) {
+	CoversTask *read = static_cast<CoversTask *>(task);
+	QHash<int, QByteArray>::const_iterator itt;
+	for (itt = hashes.constBegin(); itt != hashes.constEnd(); ++itt) {
+		if (read->hashes.value(itt.key(), "-") != itt.value()) { //NOTE: the album is gone or its tracks were imported again, its art is looked for again
+			for (int i = 0; i < NUM_COVER_SIZES; ++i)
+				pixmaps.remove(CoverKey(itt.key(), COVER_SIZES[i]));
+		}
+	}
+	hashes = read->hashes;
+	loaded = true;
+	emit coversLoaded();
+}
+
+void CoverCache::deliver() {
+	QList<CoverImage> read;
+	{
+		QMutexLocker lock(&mutex);
+		read = images;
+		images.clear();
+	}
+	QList<QPair<int, QByteArray> > found;
+	CoverImage image;
+	foreach(image, read) {
+		int alid = image.key.first;
+		requested.remove(image.key);
+		if (image.extracted && (!hashes.contains(alid) || hashes.value(alid) != image.hash)) {
+			hashes.insert(alid, image.hash);
+			found.push_back(qMakePair(alid, image.hash));
+			for (int i = 0; i < NUM_COVER_SIZES; ++i)
+				pixmaps.remove(CoverKey(alid, COVER_SIZES[i])); //NOTE: of the art the album had before
+			QMutexLocker lock(&mutex);
+			QList<CoverRequest>::iterator request = requests.begin();
+			while (request != requests.end()) { //NOTE: its other sizes waiting behind it are read without looking for the art again
+				if (request->key.first != alid)
+					++request;
+				else if (image.hash.isEmpty()) {
+					requested.remove(request->key);
+					request = requests.erase(request);
+				} else {
+					request->hash = image.hash;
+					++request;
+				}
+			}
+		}
+		pixmaps.insert(image.key, new QPixmap(QPixmap::fromImage(image.image)), qMax(image.image.byteCount() / 1024, 1)); //NOTE: a null one too, an unreadable track isn't asked for again until it drops out
+		emit coverRead(alid);
+	}
+	if (!found.isEmpty())
+		database->post(new CoverWriteTask(found));
+}
+
+bool CoverCache::takeRequest(CoverRequest &request) {
+	QMutexLocker lock(&mutex);
+	while (requests.isEmpty() && !stopped)
+		wake.wait(&mutex);
+	if (stopped)
+		return false;
+	request = requests.takeLast(); //NOTE: the rows the view shows now before those it has scrolled past
+	return true;
+}
+
+QImage CoverCache::readCover(const CoverRequest &request, QByteArray &hash, bool &extracted) {
+	int size = request.key.second;
+	QImage image;
+	extracted = false;
+	hash = request.hash;
+	if (!hash.isEmpty()) {
+		ProfileSpan span("Read cover thumbnail");
+		if (image.load(thumbnailPath(hash, size)))
+			return image;
+	}
+	ProfileSpan span("Extract cover");
+	if (!QFile::exists(request.path)) //NOTE: an unmounted share isn't recorded as having no art
+		return image;
+	extracted = true;
+	QByteArray data = readEmbedded(request.path);
+	if (data.isEmpty())
+		data = readFolder(request.path);
+	QImage original;
+	if (data.isEmpty() || !original.loadFromData(data)) {
+		hash.clear();
+		return image;
+	}
+	hash = QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+	QDir().mkpath(QFileInfo(thumbnailPath(hash, size)).path());
+	for (int i = 0; i < NUM_COVER_SIZES; ++i) {
+		QImage thumbnail = original.width() > COVER_SIZES[i] || original.height() > COVER_SIZES[i] ? original.scaled(COVER_SIZES[i], COVER_SIZES[i], Qt::KeepAspectRatio, Qt::SmoothTransformation) : original;
+		QString path = thumbnailPath(hash, COVER_SIZES[i]);
+		if (!QFile::exists(path) && thumbnail.save(path + ".part", "JPEG", THUMBNAIL_QUALITY)) //NOTE: written aside and renamed, a thumbnail that exists is whole
+			QFile::rename(path + ".part", path);
+		if (COVER_SIZES[i] == size)
+			image = thumbnail;
+	}
+	return image;
+}
+
+QString CoverCache::thumbnailPath(const QByteArray &hash, int size) const {
+	return QString("%1%2/%3-%4.jpg").arg(cache_dir).arg(QString(hash.left(2))).arg(QString(hash)).arg(size); //NOTE: split by the first byte of the hash, so no directory holds every album
+}
+
+QByteArray CoverCache::readEmbedded(const QString &path) {
+	QString suffix = QFileInfo(path).suffix().toLower();
+	QByteArray file_name = path.toUtf8(); //NOTE: as the Importer opens them
+	if (suffix == "mp3") {
+		TagLib::MPEG::File file(file_name.constData(), false);
+		return file.isValid() ? readAttachedPicture(file.ID3v2Tag()) : QByteArray();
+	}
+	if (suffix == "flac") {
+		TagLib::FLAC::File file(file_name.constData(), false);
+		if (!file.isValid())
+			return QByteArray();
+		QByteArray data = readFlacPicture(file.pictureList());
+		return data.isEmpty() ? readAttachedPicture(file.ID3v2Tag()) : data;
+	}
+	if (suffix == "ogg" || suffix == "oga") {
+		TagLib::Ogg::Vorbis::File file(file_name.constData(), false);
+		if (!file.isValid() || !file.tag())
+			return QByteArray();
+		const TagLib::Ogg::FieldListMap &fields = file.tag()->fieldListMap();
+		TagLib::Ogg::FieldListMap::ConstIterator blocks = fields.find("METADATA_BLOCK_PICTURE"); //NOTE: base64 FLAC picture blocks
+		if (blocks == fields.end())
+			return QByteArray();
+		TagLib::List<TagLib::FLAC::Picture *> pictures;
+		for (TagLib::StringList::ConstIterator itt = blocks->second.begin(); itt != blocks->second.end(); ++itt) {
+			QByteArray block = QByteArray::fromBase64(QByteArray(itt->toCString()));
+			TagLib::FLAC::Picture *picture = new TagLib::FLAC::Picture;
+			if (picture->parse(TagLib::ByteVector(block.constData(), block.size())))
+				pictures.append(picture);
+			else
+				delete picture;
+		}
+		QByteArray data = readFlacPicture(pictures);
+		for (TagLib::List<TagLib::FLAC::Picture *>::Iterator itt = pictures.begin(); itt != pictures.end(); ++itt)
+			delete *itt;
+		return data;
+	}
+	if (suffix == "m4a" || suffix == "m4b" || suffix == "mp4") {
+		TagLib::MP4::File file(file_name.constData(), false);
+		if (!file.isValid() || !file.tag())
+			return QByteArray();
+		TagLib::MP4::ItemListMap &items = file.tag()->itemListMap();
+		TagLib::MP4::ItemListMap::ConstIterator covr = items.find("covr");
+		if (covr == items.end())
+			return QByteArray();
+		TagLib::MP4::CoverArtList art = covr->second.toCoverArtList();
+		return art.isEmpty() ? QByteArray() : toByteArray(art.front().data());
+	}
+	return QByteArray();
+}
+
+QByteArray CoverCache::readFolder(const QString &path) {
+	QDir dir = QFileInfo(path).dir();
+	QStringList images = dir.entryList(QStringList() << "*.jpg" << "*.jpeg" << "*.png", QDir::Files | QDir::Readable, QDir::Name);
+	QString cover;
+	for (int i = 0; i < NUM_COVER_NAMES && cover.isEmpty(); ++i) {
+		QString image;
+		foreach(image, images) {
+			if (image.startsWith(COVER_NAMES[i], Qt::CaseInsensitive)) {
+				cover = image;
+				break;
+			}
+		}
+	}
+	if (cover.isEmpty() && images.count() == 1) //NOTE: a lone image is the cover whatever it is called, of several none is
+		cover = images.first();
+	if (cover.isEmpty())
+		return QByteArray();
+	QFile file(dir.filePath(cover));
+	return file.open(QIODevice::ReadOnly) ? file.readAll() : QByteArray();
+}
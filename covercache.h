@@ -0,0 +1,89 @@
+#ifndef _COVERCACHE_H_
+#define _COVERCACHE_H_
+
+#include <QByteArray>
+#include <QCache>
+#include <QHash>
+#include <QImage>
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QPixmap>
+#include <QSet>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "databaseworker.h"
+#include "libraryindex.h"
+
+/*
+ * The cover art of every album, as thumbnails of a few fixed sizes.  The art embedded in the first track of an
+ * album, or the cover image in its directory, is extracted once on the cache's own thread and scaled down to
+ * every size, the thumbnails are named by the SHA-1 of the original image under the cache directory, so albums
+ * sharing art share its files.  Which art each album has is kept in the `album_covers` table.  cover() only
+ * ever answers from an in-memory LRU of pixmaps, anything it doesn't hold is read or extracted in the
+ * background, most recent request first, and announced by coverRead(), so the GUI thread never decodes an image.
+ */
+class CoverCache : public QThread
+{
+	Q_OBJECT
+	
+	public:
+		enum Size {Small = 32, Large = 256}; //NOTE: the edge of the thumbnail in pixels, the album column and the track details
+		
+		CoverCache(DatabaseWorker *, const LibraryIndex *, const QString &, int = 16384, QObject * = 0); //NOTE: the memory held by the LRU, in KB
+		~CoverCache();
+		
+		void load(); //NOTE: reads `album_covers`, again after every library load, as imports drop albums from it
+		void stop();
+		QPixmap cover(int, Size); //NOTE: a null pixmap until the cover of the `alid` has been read, and for albums without art
+	
+	signals:
+		void coverRead(int);
+		void coversLoaded();
+	
+	protected:
+		void run();
+	
+	private slots:
+		void coversRead(DatabaseTask *);
+		void deliver(); //NOTE: invoked from the cache's thread when it has read images
+	
+	private:
+		typedef QPair<int, int> CoverKey; //NOTE: `alid`, Size
+		
+		struct CoverRequest {
+			CoverKey key;
+			QString path; //NOTE: of the first track of the album
+			QByteArray hash; //NOTE: empty when the album's art hasn't been looked for yet
+		};
+		
+		struct CoverImage {
+			CoverKey key;
+			QByteArray hash; //NOTE: empty when the album has no art
+			QImage image;
+			bool extracted; //NOTE: the art was looked for, `hash` is what the album has now
+		};
+		
+		bool takeRequest(CoverRequest &);
+		QImage readCover(const CoverRequest &, QByteArray &, bool &);
+		QString thumbnailPath(const QByteArray &, int) const;
+		static QByteArray readEmbedded(const QString &);
+		static QByteArray readFolder(const QString &);
+		
+		DatabaseWorker *database;
+		const LibraryIndex *library;
+		QString cache_dir;
+		QCache<CoverKey, QPixmap> pixmaps; //NOTE: cost in KB
+		QHash<int, QByteArray> hashes; //NOTE: `alid` -> its art, as in `album_covers`
+		QSet<CoverKey> requested; //NOTE: asked of the cache's thread and not delivered yet
+		bool loaded; //NOTE: `hashes` has been read, nothing is requested before
+		QList<CoverRequest> requests; //NOTE: the latest last, taken from the back
+		QList<CoverImage> images;
+		bool stopped;
+		QMutex mutex; //NOTE: guards `requests`, `images` and `stopped`, everything else belongs to the GUI thread
+		QWaitCondition wake;
+};
+
+#endif
@@ -0,0 +1,321 @@
+#include "databaseworker.h"
+#include "profiler.h"
+
+#include <QMetaObject>
+#include <QMutexLocker>
+
+/*
+ * TABLE DEF:
+ *  col   Name          Type      Key
+ *  0     tid           INTEGER   PRIMARY ASC
+ *  1     artist        VARCHAR   ASC
+ *  2     year          INT       ASC
+ *  3     album         VARCHAR
+ *  4     track_number  INT       ASC
+ *  5     title         VARCHAR
+ *  6     path          VARCHAR   UNIQUE
+ *  7     length        INT
+ *  8     playcount     INT
+ *  9     size          INT
+ *  10    mtime         INT
+ *  11    artist_id     INT       `artists`.`aid`
+ *  12    album_id      INT       `albums`.`alid`
+ *  13    shuffle_key   INT       ASC
+ *
+ * `artists` (`aid` INTEGER PRIMARY KEY, `name` UNIQUE COLLATE NOCASE)
+ * `albums`  (`alid` INTEGER PRIMARY KEY, `aid`, `year`, `name` COLLATE NOCASE), UNIQUE (`aid`, `name`), `year` is the earliest of its tracks
+ *  NOTE: rows in `artists` and `albums` are created and removed by triggers on `tracks`, never written directly
+ * `library_stats` (`artists`, `albums`, `tracks`, `length`), a single row of counts and the total length in seconds, kept by triggers
+ * `tracks_search` FTS5 (`artist`, `album`, `title`), external content from `tracks`, `rowid` is `tid`
+ * `shuffle` (`drawn`), a single row holding the `shuffle_key` of the last track drawn by ShuffleBag, -1 at the start of a pass
+ * `library_generation` (`generation`), a single row counting the changes to the tracks LibraryIndex loads, kept by triggers
+ * `queue` (`position` INTEGER PRIMARY KEY, `tid` UNIQUE), the TrackQueue in play order
+ * `history` (`position` INTEGER PRIMARY KEY, `tid` ASC), the TrackHistory, oldest first
+ * `imports` (`session` INTEGER PRIMARY KEY, `scan_dir`, `stamp_dir`), the import journal, one row per import that hasn't finished
+ * `import_files` (`session`, `path`), the files of a journaled import that was given files instead of a `scan_dir`
+ * `album_covers` (`album_id` INTEGER PRIMARY KEY, `hash`), the SHA-1 of the art CoverCache found for an album, '' for none
+ */
+
+/*
+ * SCHEMA MIGRATIONS:
+ *  `PRAGMA user_version` holds the number of migrations that have been applied to the database,
+ *  each one runs in its own transaction
+ */
+const char *MIGRATIONS[] = {
+	//1: file stamps for incremental rescans and one row per path
+	"ALTER TABLE `tracks` ADD COLUMN `size` INT; "
+	"ALTER TABLE `tracks` ADD COLUMN `mtime` INT; "
+	"DELETE FROM `tracks` WHERE `tid` NOT IN (SELECT MIN(`tid`) FROM `tracks` GROUP BY `path`); "
+	"CREATE UNIQUE INDEX IF NOT EXISTS `tracks_path` ON `tracks` (`path`)",
+	//2: normalized artists and albums, kept current by triggers, and covering indexes for the browse queries
+	"CREATE TABLE IF NOT EXISTS `artists` (`aid` INTEGER PRIMARY KEY, `name` VARCHAR UNIQUE COLLATE NOCASE); "
+	"CREATE TABLE IF NOT EXISTS `albums` (`alid` INTEGER PRIMARY KEY, `aid` INT, `year` INT, `name` VARCHAR COLLATE NOCASE, UNIQUE (`aid`, `name`)); "
+	"ALTER TABLE `tracks` ADD COLUMN `artist_id` INT; "
+	"ALTER TABLE `tracks` ADD COLUMN `album_id` INT; "
+	"INSERT OR IGNORE INTO `artists` (`name`) SELECT `artist` FROM `tracks` ORDER BY `tid`; "
+	"INSERT OR IGNORE INTO `albums` (`aid`, `year`, `name`) SELECT (SELECT `aid` FROM `artists` WHERE `name`=`artist`), `year`, `album` FROM `tracks` ORDER BY `tid`; "
+	"UPDATE `tracks` SET `artist_id`=(SELECT `aid` FROM `artists` WHERE `name`=`tracks`.`artist`); "
+	"UPDATE `tracks` SET `album_id`=(SELECT `alid` FROM `albums` WHERE `aid`=`tracks`.`artist_id` AND `name`=`tracks`.`album`); "
+	"CREATE INDEX IF NOT EXISTS `albums_year` ON `albums` (`aid`, `year`, `name`); "
+	"CREATE INDEX IF NOT EXISTS `albums_name` ON `albums` (`name`); "
+	"CREATE INDEX IF NOT EXISTS `tracks_album` ON `tracks` (`album_id`, `track_number`, `title`); "
+	"CREATE INDEX IF NOT EXISTS `tracks_artist` ON `tracks` (`artist_id`, `title` COLLATE NOCASE); "
+	"CREATE INDEX IF NOT EXISTS `tracks_title` ON `tracks` (`title` COLLATE NOCASE); "
+	"CREATE TRIGGER IF NOT EXISTS `tracks_insert` AFTER INSERT ON `tracks` BEGIN "
+	"	INSERT OR IGNORE INTO `artists` (`name`) VALUES (NEW.`artist`); "
+	"	INSERT OR IGNORE INTO `albums` (`aid`, `year`, `name`) VALUES ((SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), NEW.`year`, NEW.`album`); "
+	"	UPDATE `tracks` SET `artist_id`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), `album_id`=(SELECT `alid` FROM `albums` WHERE `aid`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`) AND `name`=NEW.`album`) WHERE `tid`=NEW.`tid`; "
+	"END; "
+	"CREATE TRIGGER IF NOT EXISTS `tracks_update` AFTER UPDATE OF `artist`, `album` ON `tracks` BEGIN "
+	"	INSERT OR IGNORE INTO `artists` (`name`) VALUES (NEW.`artist`); "
+	"	INSERT OR IGNORE INTO `albums` (`aid`, `year`, `name`) VALUES ((SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), NEW.`year`, NEW.`album`); "
+	"	UPDATE `tracks` SET `artist_id`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), `album_id`=(SELECT `alid` FROM `albums` WHERE `aid`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`) AND `name`=NEW.`album`) WHERE `tid`=NEW.`tid`; "
+	"	DELETE FROM `albums` WHERE `alid`=OLD.`album_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `album_id`=OLD.`album_id`); "
+	"	DELETE FROM `artists` WHERE `aid`=OLD.`artist_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `artist_id`=OLD.`artist_id`); "
+	"END; "
+	"CREATE TRIGGER IF NOT EXISTS `tracks_delete` AFTER DELETE ON `tracks` BEGIN "
+	"	DELETE FROM `albums` WHERE `alid`=OLD.`album_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `album_id`=OLD.`album_id`); "
+	"	DELETE FROM `artists` WHERE `aid`=OLD.`artist_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `artist_id`=OLD.`artist_id`); "
+	"END",
+	//3: persisted shuffle bag, keys are below 2^62 and imported tracks are drawn later in the current pass
+	"ALTER TABLE `tracks` ADD COLUMN `shuffle_key` INT; "
+	"UPDATE `tracks` SET `shuffle_key`=(random() & 4611686018427387903); "
+	"CREATE INDEX IF NOT EXISTS `tracks_shuffle` ON `tracks` (`shuffle_key`, `tid`); "
+	"CREATE TABLE IF NOT EXISTS `shuffle` (`drawn` INT); "
+	"INSERT INTO `shuffle` (`drawn`) VALUES (-1); "
+	"CREATE TRIGGER IF NOT EXISTS `tracks_shuffle` AFTER INSERT ON `tracks` BEGIN "
+	"	UPDATE `tracks` SET `shuffle_key`=(SELECT `drawn` + 1 + (random() & 4611686018427387903) % (4611686018427387903 - `drawn`) FROM `shuffle`) WHERE `tid`=NEW.`tid`; "
+	"END",
+	//4: library statistics kept current by triggers, and the index the top tracks are paged from
+	"CREATE TABLE IF NOT EXISTS `library_stats` (`artists` INT, `albums` INT, `tracks` INT, `length` INT); "
+	"INSERT INTO `library_stats` SELECT (SELECT COUNT(*) FROM `artists`), (SELECT COUNT(*) FROM `albums`), (SELECT COUNT(*) FROM `tracks`), (SELECT IFNULL(SUM(`length`), 0) FROM `tracks`); "
+	"CREATE INDEX IF NOT EXISTS `tracks_playcount` ON `tracks` (`playcount`, `tid`); "
+	"CREATE TRIGGER IF NOT EXISTS `stats_artist_insert` AFTER INSERT ON `artists` BEGIN UPDATE `library_stats` SET `artists`=`artists` + 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_artist_delete` AFTER DELETE ON `artists` BEGIN UPDATE `library_stats` SET `artists`=`artists` - 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_album_insert` AFTER INSERT ON `albums` BEGIN UPDATE `library_stats` SET `albums`=`albums` + 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_album_delete` AFTER DELETE ON `albums` BEGIN UPDATE `library_stats` SET `albums`=`albums` - 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_track_insert` AFTER INSERT ON `tracks` BEGIN UPDATE `library_stats` SET `tracks`=`tracks` + 1, `length`=`length` + IFNULL(NEW.`length`, 0); END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_track_delete` AFTER DELETE ON `tracks` BEGIN UPDATE `library_stats` SET `tracks`=`tracks` - 1, `length`=`length` - IFNULL(OLD.`length`, 0); END; "
+	"CREATE TRIGGER IF NOT EXISTS `stats_track_length` AFTER UPDATE OF `length` ON `tracks` BEGIN UPDATE `library_stats` SET `length`=`length` + IFNULL(NEW.`length`, 0) - IFNULL(OLD.`length`, 0); END",
+	//5: full text search over artists, albums and titles, the index reads its text from `tracks` and is kept current by triggers
+	"CREATE VIRTUAL TABLE IF NOT EXISTS `tracks_search` USING fts5(`artist`, `album`, `title`, content='tracks', content_rowid='tid', prefix='1 2 3'); "
+	"INSERT INTO `tracks_search` (`tracks_search`) VALUES ('rebuild'); "
+	"CREATE TRIGGER IF NOT EXISTS `search_insert` AFTER INSERT ON `tracks` BEGIN "
+	"	INSERT INTO `tracks_search` (`rowid`, `artist`, `album`, `title`) VALUES (NEW.`tid`, NEW.`artist`, NEW.`album`, NEW.`title`); "
+	"END; "
+	"CREATE TRIGGER IF NOT EXISTS `search_delete` AFTER DELETE ON `tracks` BEGIN "
+	"	INSERT INTO `tracks_search` (`tracks_search`, `rowid`, `artist`, `album`, `title`) VALUES ('delete', OLD.`tid`, OLD.`artist`, OLD.`album`, OLD.`title`); "
+	"END; "
+	"CREATE TRIGGER IF NOT EXISTS `search_update` AFTER UPDATE OF `artist`, `album`, `title` ON `tracks` BEGIN "
+	"	INSERT INTO `tracks_search` (`tracks_search`, `rowid`, `artist`, `album`, `title`) VALUES ('delete', OLD.`tid`, OLD.`artist`, OLD.`album`, OLD.`title`); "
+	"	INSERT INTO `tracks_search` (`rowid`, `artist`, `album`, `title`) VALUES (NEW.`tid`, NEW.`artist`, NEW.`album`, NEW.`title`); "
+	"END",
+	//6: a counter bumped by every change to what LibraryIndex holds, a library snapshot is only used while it matches,
+	//it starts at random so a new database never matches the snapshot of an old one
+	"CREATE TABLE IF NOT EXISTS `library_generation` (`generation` INT); "
+	"INSERT INTO `library_generation` (`generation`) VALUES (random() & 4611686018427387903); "
+	"CREATE TRIGGER IF NOT EXISTS `generation_insert` AFTER INSERT ON `tracks` BEGIN UPDATE `library_generation` SET `generation`=`generation` + 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `generation_delete` AFTER DELETE ON `tracks` BEGIN UPDATE `library_generation` SET `generation`=`generation` + 1; END; "
+	"CREATE TRIGGER IF NOT EXISTS `generation_update` AFTER UPDATE OF `artist`, `year`, `album`, `track_number`, `title`, `path` ON `tracks` BEGIN UPDATE `library_generation` SET `generation`=`generation` + 1; END",
+	//7: the track queue, kept across restarts, `position` orders it and a deleted track leaves it
+	"CREATE TABLE IF NOT EXISTS `queue` (`position` INTEGER PRIMARY KEY, `tid` INT NOT NULL UNIQUE); "
+	"CREATE TRIGGER IF NOT EXISTS `queue_delete` AFTER DELETE ON `tracks` BEGIN DELETE FROM `queue` WHERE `tid`=OLD.`tid`; END",
+	//8: the play history, kept across restarts, the latest track has the highest `position` and a deleted track leaves it
+	"CREATE TABLE IF NOT EXISTS `history` (`position` INTEGER PRIMARY KEY, `tid` INT NOT NULL); "
+	"CREATE INDEX IF NOT EXISTS `history_tid` ON `history` (`tid`); "
+	"CREATE TRIGGER IF NOT EXISTS `history_delete` AFTER DELETE ON `tracks` BEGIN DELETE FROM `history` WHERE `tid`=OLD.`tid`; END",
+	//9: the import journal, an import that was canceled or cut short is resumed from it, its files go with its row
+	"CREATE TABLE IF NOT EXISTS `imports` (`session` INTEGER PRIMARY KEY, `scan_dir` VARCHAR, `stamp_dir` VARCHAR); "
+	"CREATE TABLE IF NOT EXISTS `import_files` (`session` INT NOT NULL, `path` VARCHAR); "
+	"CREATE INDEX IF NOT EXISTS `import_files_session` ON `import_files` (`session`); "
+	"CREATE TRIGGER IF NOT EXISTS `imports_delete` AFTER DELETE ON `imports` BEGIN DELETE FROM `import_files` WHERE `session`=OLD.`session`; END",
+	//10: the art found for each album, an album leaves it when it is deleted or a track of it is imported, so its art is looked for again
+	"CREATE TABLE IF NOT EXISTS `album_covers` (`album_id` INTEGER PRIMARY KEY, `hash` VARCHAR NOT NULL); "
+	"CREATE TRIGGER IF NOT EXISTS `album_covers_delete` AFTER DELETE ON `albums` BEGIN DELETE FROM `album_covers` WHERE `album_id`=OLD.`alid`; END; "
+	"CREATE TRIGGER IF NOT EXISTS `album_covers_update` AFTER UPDATE OF `album_id`, `mtime` ON `tracks` BEGIN DELETE FROM `album_covers` WHERE `album_id` IN (OLD.`album_id`, NEW.`album_id`); END",
+	//11: an album's year follows its tracks, the earliest one they are tagged with, so a retag or a removed track moves the album,
+	//the triggers of 2 set it once from the first track, and a changed year bumps the generation the snapshot was written at
+	"DROP TRIGGER IF EXISTS `tracks_insert`; "
+	"DROP TRIGGER IF EXISTS `tracks_update`; "
+	"DROP TRIGGER IF EXISTS `tracks_delete`; "
+	"CREATE TRIGGER `tracks_insert` AFTER INSERT ON `tracks` BEGIN "
+	"	INSERT OR IGNORE INTO `artists` (`name`) VALUES (NEW.`artist`); "
+	"	INSERT OR IGNORE INTO `albums` (`aid`, `year`, `name`) VALUES ((SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), NEW.`year`, NEW.`album`); "
+	"	UPDATE `tracks` SET `artist_id`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), `album_id`=(SELECT `alid` FROM `albums` WHERE `aid`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`) AND `name`=NEW.`album`) WHERE `tid`=NEW.`tid`; "
+	"	UPDATE `albums` SET `year`=(SELECT IFNULL(MIN(NULLIF(`year`, 0)), 0) FROM `tracks` WHERE `album_id`=`alid`) WHERE `alid`=(SELECT `album_id` FROM `tracks` WHERE `tid`=NEW.`tid`); "
+	"END; "
+	"CREATE TRIGGER `tracks_update` AFTER UPDATE OF `artist`, `year`, `album` ON `tracks` BEGIN "
+	"	INSERT OR IGNORE INTO `artists` (`name`) VALUES (NEW.`artist`); "
+	"	INSERT OR IGNORE INTO `albums` (`aid`, `year`, `name`) VALUES ((SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), NEW.`year`, NEW.`album`); "
+	"	UPDATE `tracks` SET `artist_id`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`), `album_id`=(SELECT `alid` FROM `albums` WHERE `aid`=(SELECT `aid` FROM `artists` WHERE `name`=NEW.`artist`) AND `name`=NEW.`album`) WHERE `tid`=NEW.`tid`; "
+	"	DELETE FROM `albums` WHERE `alid`=OLD.`album_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `album_id`=OLD.`album_id`); "
+	"	DELETE FROM `artists` WHERE `aid`=OLD.`artist_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `artist_id`=OLD.`artist_id`); "
+	"	UPDATE `albums` SET `year`=(SELECT IFNULL(MIN(NULLIF(`year`, 0)), 0) FROM `tracks` WHERE `album_id`=`alid`) WHERE `alid` IN (OLD.`album_id`, (SELECT `album_id` FROM `tracks` WHERE `tid`=NEW.`tid`)); "
+	"END; "
+	"CREATE TRIGGER `tracks_delete` AFTER DELETE ON `tracks` BEGIN "
+	"	DELETE FROM `albums` WHERE `alid`=OLD.`album_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `album_id`=OLD.`album_id`); "
+	"	DELETE FROM `artists` WHERE `aid`=OLD.`artist_id` AND NOT EXISTS (SELECT 1 FROM `tracks` WHERE `artist_id`=OLD.`artist_id`); "
+	"	UPDATE `albums` SET `year`=(SELECT IFNULL(MIN(NULLIF(`year`, 0)), 0) FROM `tracks` WHERE `album_id`=`alid`) WHERE `alid`=OLD.`album_id`; "
+	"END; "
+	"UPDATE `albums` SET `year`=(SELECT IFNULL(MIN(NULLIF(`year`, 0)), 0) FROM `tracks` WHERE `album_id`=`alid`); "
+	"UPDATE `library_generation` SET `generation`=`generation` + 1"
+};
+const int NUM_MIGRATIONS = sizeof(MIGRATIONS) / sizeof(*MIGRATIONS);
+const int BUSY_TIMEOUT = 30000; //NOTE: ms a write waits for the transaction of another worker, an import commits a batch at a time
+
+DatabaseTask::DatabaseTask(const QString &failure_msg) : failure_msg(failure_msg), method(0), failed(false), error_code(0) {
+}
+
+DatabaseTask::~DatabaseTask() {
+}
+
+bool DatabaseTask::exec(sqlite3 *db, const char *query) {
+	return sqlite3_exec(db, query, 0, 0, 0) == SQLITE_OK;
+}
+
+ExecTask::ExecTask(char *query, const QString &failure_msg) : DatabaseTask(failure_msg), query(query) {
+	sqlite3_free(query);
+}
+
+bool ExecTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	return exec(db, query.constData());
+}
+
+DatabaseWorker::DatabaseWorker(const QString &db_path, QObject *parent) : QThread(parent), db_path(db_path), db(0), error_code(0), stopped(false) {
+	connect(this, SIGNAL(tasksFinished()), this, SLOT(deliver()), Qt::QueuedConnection);
+}
+
+DatabaseWorker::~DatabaseWorker() {
+	stop();
+	wait();
+	qDeleteAll(pending);
+	qDeleteAll(finished);
+}
+
+void DatabaseWorker::post(DatabaseTask *task, QObject *receiver, const char *method) {
+	task->receiver = receiver;
+	task->method = method;
+	QMutexLocker lock(&mutex);
+	pending.enqueue(task);
+	wake.wakeOne();
+}
+
+void DatabaseWorker::stop() {
+	QMutexLocker lock(&mutex);
+	stopped = true;
+	wake.wakeOne();
+}
+
+int DatabaseWorker::errorCode() {
+	QMutexLocker lock(&mutex);
+	return error_code;
+}
+
+void DatabaseWorker::run() {
+	QString failure_msg;
+	if (!openDatabase(db_path, &db, failure_msg)) {
+		fail(failure_msg, sqlite3_errmsg(db));
+		sqlite3_close(db);
+		db = 0;
+		return;
+	}
+	forever {
+		DatabaseTask *task;
+		{
+			QMutexLocker lock(&mutex);
+			while (pending.isEmpty() && !stopped)
+				wake.wait(&mutex);
+			if (pending.isEmpty()) //NOTE: stopped, but only once everything posted before stop() has been written
+				break;
+			task = pending.dequeue();
+		}
+		if (!task->run(db)) {
+			task->failed = true;
+			task->errmsg = sqlite3_errmsg(db);
+			task->error_code = sqlite3_errcode(db);
+		}
+		QMutexLocker lock(&mutex);
+		finished.enqueue(task);
+		if (finished.count() == 1) //NOTE: one delivery drains every task that finishes before it runs
+			emit tasksFinished();
+	}
+	sqlite3_stmt *stmt;
+	while ((stmt = sqlite3_next_stmt(db, 0))) //NOTE: statements left open by tasks that were never delivered
+		sqlite3_finalize(stmt);
+	sqlite3_close(db);
+	db = 0;
+}
+
+void DatabaseWorker::deliver() {
+	QQueue<DatabaseTask *> tasks;
+	{
+		QMutexLocker lock(&mutex);
+		tasks.swap(finished);
+	}
+	DatabaseTask *task;
+	foreach(task, tasks) {
+		if (task->failed) {
+			{
+				QMutexLocker lock(&mutex);
+				error_code = task->error_code;
+			}
+			emit error(task->failure_msg, task->errmsg);
+		}
+		else if (task->receiver && task->method) {
+			ProfileSpan span(task->method); //NOTE: the GUI thread's share of the task, named after the slot
+			QMetaObject::invokeMethod(task->receiver, task->method, Qt::DirectConnection, Q_ARG(DatabaseTask *, task));
+		}
+		delete task;
+	}
+}
+
+bool DatabaseWorker::openDatabase(const QString &path, sqlite3 **db, QString &failure_msg) {
+	if (sqlite3_open(path.toUtf8().constData(), db)) {
+		failure_msg = "Failed to open the Projekt7 Track Database: ";
+		return false;
+	}
+	sqlite3_busy_timeout(*db, BUSY_TIMEOUT); //NOTE: WAL lets readers run alongside a writer, writers still take turns
+	const char *tune_database = "PRAGMA journal_mode=WAL; PRAGMA synchronous=NORMAL; PRAGMA cache_size=8000; PRAGMA temp_store=MEMORY";
+	if (!DatabaseTask::exec(*db, tune_database)) {
+		failure_msg = "Failed to configure the Projekt7 Track Database: ";
+		return false;
+	}
+	const char *create_table = "CREATE TABLE IF NOT EXISTS `tracks` (`tid` INTEGER PRIMARY KEY, `artist` VARCHAR KEY ASC, `year` INT KEY ASC, `album` VARCHAR, `track_number` INT KEY ASC, `title` VARCHAR, `path` VARCHAR, `length` INT, `playcount` INT)";
+	if (!DatabaseTask::exec(*db, create_table)) {
+		failure_msg = "Failed to create `tracks` table: ";
+		return false;
+	}
+	return updateSchema(*db, failure_msg);
+}
+
+bool DatabaseWorker::updateSchema(sqlite3 *db, QString &failure_msg) {
+	sqlite3_stmt *stmt = 0;
+	int version = 0;
+	if (sqlite3_prepare_v2(db, "PRAGMA user_version", -1, &stmt, 0)) {
+		failure_msg = "Failed to Prepare schema version query: ";
+		return false;
+	}
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+		version = sqlite3_column_int(stmt, 0);
+	sqlite3_finalize(stmt);
+	for (; version < NUM_MIGRATIONS; ++version) {
+		ProfileSpan span("Failed to update the Projekt7 Track Database: ");
+		char *migration = sqlite3_mprintf("BEGIN; %s; PRAGMA user_version=%d; COMMIT", MIGRATIONS[version], version + 1);
+		bool migrated = DatabaseTask::exec(db, migration);
+		sqlite3_free(migration);
+		if (!migrated) {
+			failure_msg = "Failed to update the Projekt7 Track Database: ";
+			return false;
+		}
+	}
+	return true;
+}
+
+void DatabaseWorker::fail(const QString &part1, const QString &part2) {
+	{
+		QMutexLocker lock(&mutex);
+		error_code = sqlite3_errcode(db);
+	}
+	emit error(part1, part2); //NOTE: queued to the GUI thread, nothing posted will ever run
+}
@@ -0,0 +1,102 @@
+#ifndef _DATABASEWORKER_H_
+#define _DATABASEWORKER_H_
+
+#include <QByteArray>
+#include <QMutex>
+#include <QObject>
+#include <QPointer>
+#include <QQueue>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <sqlite3.h>
+
+/*
+ * A request to the DatabaseWorker.  run() is called on the worker thread with the connection to itself and
+ * returns false on failure, the results are left in the task's own members for the receiver to read back on
+ * the GUI thread.
+ */
+class DatabaseTask
+{
+	public:
+		DatabaseTask(const QString &);
+		virtual ~DatabaseTask();
+		
+		virtual bool run(sqlite3 *) = 0;
+	
+	protected:
+		static bool exec(sqlite3 *, const char *);
+		
+		QString failure_msg;
+	
+	private:
+		friend class DatabaseWorker;
+		QPointer<QObject> receiver;
+		const char *method;
+		QString errmsg;
+		bool failed;
+		int error_code;
+};
+
+/*
+ * A statement that returns no rows, written with sqlite3_mprintf like every other query in the player.
+ */
+class ExecTask : public DatabaseTask
+{
+	public:
+		ExecTask(char *, const QString &);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QByteArray query;
+};
+
+/*
+ * Owns the connection to the Projekt7 Track Database: opens it, brings the schema up to date and then runs
+ * posted tasks one at a time, in the order they were posted.  A finished task is handed back on the GUI
+ * thread to the receiver's slot, `void method(DatabaseTask *)`, and deleted once the slot returns, so the
+ * GUI never waits on SQLite.  A failed task goes to error() instead of its receiver.  Tasks only queue behind
+ * the tasks of their own worker, so work that runs for minutes, like an import, gets a worker of its own and
+ * the short reads and writes behind the GUI never wait for it: each worker has its own connection, readers
+ * run alongside a writer in WAL mode and a write waits for the other worker's transaction to commit.  Only
+ * one worker may bring the schema up to date, a second one is started once the first has opened the database.
+ */
+class DatabaseWorker : public QThread
+{
+	Q_OBJECT
+	
+	public:
+		DatabaseWorker(const QString &, QObject * = 0);
+		~DatabaseWorker();
+		
+		void post(DatabaseTask *, QObject * = 0, const char * = 0); //NOTE: takes ownership of the task
+		void stop(); //NOTE: the tasks already posted still run
+		int errorCode();
+		static bool openDatabase(const QString &, sqlite3 **, QString &); //NOTE: opens, tunes and migrates, for whoever needs a connection of their own, not while another migrates
+	
+	signals:
+		void tasksFinished();
+		void error(const QString &, const QString &);
+	
+	protected:
+		void run();
+	
+	private slots:
+		void deliver();
+	
+	private:
+		static bool updateSchema(sqlite3 *, QString &);
+		void fail(const QString &, const QString &);
+		
+		QString db_path;
+		sqlite3 *db;
+		QQueue<DatabaseTask *> pending, finished;
+		int error_code;
+		bool stopped;
+		QMutex mutex;
+		QWaitCondition wake;
+};
+
+#endif
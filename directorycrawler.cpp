@@ -0,0 +1,221 @@
+#include "directorycrawler.h"
+#include "profiler.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+#include <dirent.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+
+//NOTE: the extensions TagLib's FileRef opens, it picks its reader by extension too, so nothing it could read is filtered out
+static const char *AUDIO_EXTENSIONS[] = {"3g2", "aac", "aif", "aiff", "ape", "asf", "dff", "dsf", "flac", "it", "m4a", "m4b", "m4p", "m4r", "mod", "module",
+                                         "mp2", "mp3", "mp4", "mpc", "nst", "oga", "ogg", "opus", "s3m", "spx", "tta", "wav", "wma", "wow", "wv", "xm", 0};
+
+DirectoryCrawler::DirectoryCrawler(const QStringList &root_dirs, const QStringList &files, int num_threads) : num_threads(qMax(num_threads, 1)), canceled(false) {
+	QString path;
+	foreach(path, root_dirs) {
+		QString canonical = QFileInfo(path).canonicalFilePath(); //NOTE: empty for a directory that doesn't exist
+		if (canonical.isEmpty())
+			unreadable_dirs.push_back(path);
+		else if (!entered.contains(canonical)) {
+			CrawlDir root(QDir::cleanPath(path), canonical); //NOTE: without a trailing slash, as the paths in `tracks` are built
+			roots.push_back(root);
+			dirs.enqueue(root);
+			entered.insert(canonical);
+		}
+	}
+	pending_dirs = dirs.count();
+	foreach(path, files) {
+		if (isAudioFile(path) && !found_files.contains(path)) {
+			ready.enqueue(path);
+			found_files.insert(path);
+		}
+	}
+}
+
+DirectoryCrawler::~DirectoryCrawler() {
+	cancel();
+	CrawlThread *thread;
+	foreach(thread, threads) {
+		thread->wait();
+		delete thread;
+	}
+}
+
+void DirectoryCrawler::start() {
+	if (dirs.isEmpty()) //NOTE: only files were given, they are all ready
+		return;
+	for (int i = 0; i < num_threads; ++i) { //NOTE: the walk waits on the disk or the network, not the CPU, so it runs more threads than cores
+		CrawlThread *thread = new CrawlThread(this);
+		threads.push_back(thread);
+		thread->start();
+	}
+}
+
+void DirectoryCrawler::cancel() {
+	QMutexLocker lock(&mutex);
+	canceled = true;
+	dirs_ready.wakeAll();
+	files_ready.wakeAll();
+}
+
+bool DirectoryCrawler::next(QString &path) {
+	QMutexLocker lock(&mutex);
+	while (ready.isEmpty() && pending_dirs > 0 && !canceled)
+		files_ready.wait(&mutex);
+	if (canceled || ready.isEmpty())
+		return false;
+	path = ready.dequeue();
+	return true;
+}
+
+int DirectoryCrawler::found() {
+	QMutexLocker lock(&mutex);
+	return found_files.count();
+}
+
+QSet<QString> DirectoryCrawler::files() {
+	QMutexLocker lock(&mutex);
+	return found_files;
+}
+
+QStringList DirectoryCrawler::unreadable() {
+	QMutexLocker lock(&mutex);
+	return unreadable_dirs;
+}
+
+bool DirectoryCrawler::isAudioFile(const QString &path) {
+	int dot = path.lastIndexOf('.');
+	if (dot == -1 || path.indexOf('/', dot) != -1)
+		return false;
+	QString extension = path.mid(dot + 1).toLower();
+	for (const char **itt = AUDIO_EXTENSIONS; *itt; ++itt) {
+		if (extension == QLatin1String(*itt))
+			return true;
+	}
+	return false;
+}
+
+bool DirectoryCrawler::nextDir(CrawlDir &dir) {
+	QMutexLocker lock(&mutex);
+	while (dirs.isEmpty() && pending_dirs > 0 && !canceled)
+		dirs_ready.wait(&mutex);
+	if (canceled || dirs.isEmpty())
+		return false;
+	dir = dirs.dequeue();
+	return true;
+}
+
+QString DirectoryCrawler::foundPath(const QString &canonical) const {
+	CrawlDir root;
+	foreach(root, roots) {
+		if (canonical == root.second)
+			return root.first;
+		QString prefix = root.second.endsWith('/') ? root.second : root.second + '/';
+		if (canonical.startsWith(prefix))
+			return (root.first.endsWith('/') ? root.first : root.first + '/') + canonical.mid(prefix.length());
+	}
+	return canonical; //NOTE: a symlink out of every root, its files are found where they are
+}
+
+void DirectoryCrawler::dirRead(const QList<CrawlDir> &subdirs, const QStringList &files, const QStringList &unreadable) {
+	QMutexLocker lock(&mutex);
+	int queued = 0;
+	CrawlDir dir;
+	foreach(dir, subdirs) {
+		if (!entered.contains(dir.second)) {
+			dirs.enqueue(dir);
+			entered.insert(dir.second);
+			++queued;
+		}
+	}
+	unreadable_dirs += unreadable;
+	QString path;
+	foreach(path, files) {
+		if (!found_files.contains(path)) {
+			ready.enqueue(path);
+			found_files.insert(path);
+		}
+	}
+	pending_dirs += queued - 1;
+	if (queued > 0 || pending_dirs == 0)
+		dirs_ready.wakeAll(); //NOTE: at 0 the idle threads wake to find the walk over
+	if (!files.isEmpty() || pending_dirs == 0)
+		files_ready.wakeAll();
+}
+
+CrawlThread::CrawlThread(DirectoryCrawler *crawler) : crawler(crawler) {
+}
+
+void CrawlThread::run() {
+	CrawlDir dir;
+	while (crawler->nextDir(dir)) {
+		QList<CrawlDir> subdirs;
+		QStringList files, unreadable;
+		{
+			ProfileSpan span("Scan directories");
+			readDirectory(dir, subdirs, files, unreadable);
+		}
+		crawler->dirRead(subdirs, files, unreadable); //NOTE: also for a directory that couldn't be read, it is no longer pending
+	}
+}
+
+void CrawlThread::readDirectory(const CrawlDir &dir, QList<CrawlDir> &subdirs, QStringList &files, QStringList &unreadable) {
+	DIR *handle = opendir(QFile::encodeName(dir.second).constData());
+	if (!handle) {
+		unreadable.push_back(dir.first);
+		return;
+	}
+	QString prefix = dir.first.endsWith('/') ? dir.first : dir.first + '/';
+	QString canonical_prefix = dir.second.endsWith('/') ? dir.second : dir.second + '/';
+	struct dirent *entry;
+	for (;;) {
+		errno = 0; //NOTE: readdir() returns 0 both at the end and on an error, only errno tells them apart
+		if (!(entry = readdir(handle)))
+			break;
+		if (entry->d_name[0] == '.') //NOTE: hidden entries, and "." and "..", which QDir skipped as well
+			continue;
+		QString name = QFile::decodeName(entry->d_name);
+		QString path = prefix + name;
+		QByteArray encoded_path = QFile::encodeName(canonical_prefix + name);
+		unsigned char type = entry->d_type;
+		struct stat info;
+		if (type == DT_UNKNOWN) { //NOTE: the file system didn't say
+			if (lstat(encoded_path.constData(), &info)) {
+				unreadable.push_back(path);
+				continue;
+			}
+			type = S_ISLNK(info.st_mode) ? DT_LNK : S_ISDIR(info.st_mode) ? DT_DIR : S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN;
+		}
+		if (type == DT_LNK) {
+			if (stat(encoded_path.constData(), &info)) {
+				if (errno != ENOENT) //NOTE: ENOENT is a dangling symlink, anything else may have tracks behind it
+					unreadable.push_back(path);
+				continue;
+			}
+			if (S_ISDIR(info.st_mode)) {
+				char *resolved = realpath(encoded_path.constData(), 0);
+				if (!resolved) {
+					unreadable.push_back(path);
+					continue;
+				}
+				QString canonical = QFile::decodeName(resolved);
+				free(resolved);
+				subdirs.push_back(CrawlDir(crawler->foundPath(canonical), canonical));
+				continue;
+			}
+			type = S_ISREG(info.st_mode) ? DT_REG : DT_UNKNOWN; //NOTE: a file keeps the path of its symlink
+		}
+		if (type == DT_DIR)
+			subdirs.push_back(CrawlDir(path, canonical_prefix + name));
+		else if (type == DT_REG && DirectoryCrawler::isAudioFile(path))
+			files.push_back(path);
+	}
+	if (errno) //NOTE: read in part, the rest of it wasn't seen
+		unreadable.push_back(dir.first);
+	closedir(handle);
+}
@@ -0,0 +1,75 @@
+#ifndef _DIRECTORYCRAWLER_H_
+#define _DIRECTORYCRAWLER_H_
+
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QQueue>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+class CrawlThread;
+
+typedef QPair<QString, QString> CrawlDir; //NOTE: the path its files are found under, and its canonical path
+
+/*
+ * Walks directory trees for audio files on several threads at once and hands every file out through next()
+ * as soon as its directory has been read, so the TagReaders start on the first directory instead of waiting
+ * for the whole walk.  Entries are told apart by the type readdir() reports, only directories, symlinks and
+ * entries of file systems that don't report a type cost a stat().  Files are filtered by extension before
+ * they are handed out.  Each directory is entered once by its canonical path, and its files are found under
+ * that path, rewritten under the root it is in, so a directory reached through a symlink as well is always
+ * found under the same path whichever thread gets to it first, and a symlink that points back up the tree is
+ * not followed.  The directories that couldn't be read are kept, what was known under them wasn't looked for.
+ */
+class DirectoryCrawler
+{
+	public:
+		DirectoryCrawler(const QStringList &, const QStringList & = QStringList(), int = 8); //NOTE: directories to walk, files to hand out as if found
+		~DirectoryCrawler();
+		
+		void start();
+		void cancel();
+		bool next(QString &); //NOTE: waits for a file, false once the walk is over and every file has been taken
+		int found();
+		QSet<QString> files(); //NOTE: every file found so far, all of them once next() has returned false
+		QStringList unreadable(); //NOTE: the directories that couldn't be read, or only in part, and unreadable symlinks
+		
+		static bool isAudioFile(const QString &);
+	
+	private:
+		friend class CrawlThread;
+		bool nextDir(CrawlDir &);
+		QString foundPath(const QString &) const;
+		void dirRead(const QList<CrawlDir> &, const QStringList &, const QStringList &);
+		
+		QList<CrawlDir> roots; //NOTE: set once, read by the threads without the lock
+		QQueue<CrawlDir> dirs;
+		QQueue<QString> ready;
+		QSet<QString> found_files, entered; //NOTE: `entered` holds the canonical path of every directory queued
+		QStringList unreadable_dirs;
+		int pending_dirs, num_threads; //NOTE: `pending_dirs` are queued or being read, the walk is over at 0
+		bool canceled;
+		QMutex mutex;
+		QWaitCondition dirs_ready, files_ready;
+		QList<CrawlThread *> threads;
+};
+
+class CrawlThread : public QThread
+{
+	public:
+		CrawlThread(DirectoryCrawler *);
+	
+	protected:
+		void run();
+	
+	private:
+		void readDirectory(const CrawlDir &, QList<CrawlDir> &, QStringList &, QStringList &);
+		
+		DirectoryCrawler *crawler;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "importer.h"
+#include "profiler.h"
+#include "tagparser.h"
+
+#include <QDateTime>
+#include <QFileInfo>
+#include <QMutexLocker>
+
+Importer::Importer(DirectoryCrawler *crawler, const FileStamps &known, int capacity) : crawler(crawler), known(known), files_done(0), files_unchanged(0), capacity(capacity), running_readers(0), canceled(false) {
+}
+
+Importer::~Importer() {
+	cancel();
+	TagReader *reader;
+	foreach(reader, readers) {
+		reader->wait();
+		delete reader;
+	}
+}
+
+void Importer::start() {
+	int num_readers = qMax(QThread::idealThreadCount(), 1);
+	running_readers = num_readers;
+	for (int i = 0; i < num_readers; ++i) {
+		TagReader *reader = new TagReader(this);
+		readers.push_back(reader);
+		reader->start();
+	}
+}
+
+void Importer::cancel() {
+	crawler->cancel();
+	QMutexLocker lock(&mutex);
+	canceled = true;
+	tracks.clear();
+	not_full.wakeAll();
+	not_empty.wakeAll();
+}
+
+bool Importer::take(TrackInfo &track, unsigned long timeout) {
+	QMutexLocker lock(&mutex);
+	if (tracks.isEmpty() && running_readers > 0 && !canceled)
+		not_empty.wait(&mutex, timeout);
+	if (tracks.isEmpty())
+		return false;
+	track = tracks.dequeue();
+	not_full.wakeOne();
+	return true;
+}
+
+bool Importer::atEnd() {
+	QMutexLocker lock(&mutex);
+	return canceled || (running_readers == 0 && tracks.isEmpty());
+}
+
+int Importer::progress() {
+	QMutexLocker lock(&mutex);
+	return files_done;
+}
+
+int Importer::unchanged() {
+	QMutexLocker lock(&mutex);
+	return files_unchanged;
+}
+
+bool Importer::nextPath(QString &path) {
+	{
+		QMutexLocker lock(&mutex);
+		if (canceled)
+			return false;
+	}
+	return crawler->next(path); //NOTE: outside the lock, it waits for the walk
+}
+
+void Importer::put(const TrackInfo &track) {
+	QMutexLocker lock(&mutex);
+	while (tracks.count() >= capacity && !canceled)
+		not_full.wait(&mutex);
+	++files_done;
+	if (canceled)
+		return;
+	tracks.enqueue(track);
+	not_empty.wakeOne();
+}
+
+void Importer::skip(bool unchanged) {
+	QMutexLocker lock(&mutex);
+	++files_done;
+	if (unchanged)
+		++files_unchanged;
+}
+
+bool Importer::isUnchanged(const QString &path, const FileStamp &stamp) const {
+	FileStamps::const_iterator known_stamp = known.constFind(path);
+	return known_stamp != known.constEnd() && known_stamp->size == stamp.size && known_stamp->mtime == stamp.mtime;
+}
+
+void Importer::readerFinished() {
+	QMutexLocker lock(&mutex);
+	--running_readers;
+	not_empty.wakeAll();
+}
+
+TagReader::TagReader(Importer *importer) : importer(importer) {
+}
+
+void TagReader::run() {
+	QString path;
+	while (importer->nextPath(path)) {
+		QFileInfo info(path);
+		FileStamp stamp;
+		stamp.size = info.size();
+		stamp.mtime = info.lastModified().toTime_t();
+		if (importer->isUnchanged(path, stamp)) {
+			importer->skip(true);
+			continue;
+		}
+		TrackInfo track;
+		track.path = path;
+		track.stamp = stamp;
+		bool read;
+		{
+			ProfileSpan span("Read tags"); //NOTE: ends before put(), which waits whenever the writer falls behind
+			read = TagParser(path).read(track);
+		}
+		if (!read) {
+			ProfileSpan span("Read tags with TagLib"); //NOTE: the formats and tags TagParser leaves alone
+			read = TagParser::readTagLib(path, track);
+		}
+		if (!read) {
+			importer->skip();
+			continue;
+		}
+		importer->put(track);
+	}
+	importer->readerFinished();
+}
@@ -0,0 +1,80 @@
+#ifndef _IMPORTER_H_
+#define _IMPORTER_H_
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+#include "directorycrawler.h"
+
+struct FileStamp {
+	qint64 size;
+	uint mtime;
+};
+
+typedef QHash<QString, FileStamp> FileStamps; //NOTE: path -> stamp of the file when its tags were last read
+
+struct TrackInfo {
+	QString path, artist, album, title;
+	uint year, track_number;
+	int length;
+	FileStamp stamp;
+};
+
+class TagReader;
+
+/*
+ * Reads tag information on one TagReader thread per core and hands the results to a single consumer
+ * (the database writer) through a bounded queue, so the readers can never run away from the writer.
+ * Files whose size and modification time match their known stamp are skipped without opening them.  The
+ * files are taken from a DirectoryCrawler as it finds them, canceling the import cancels the walk.
+ */
+class Importer
+{
+	public:
+		Importer(DirectoryCrawler *, const FileStamps & = FileStamps(), int = 256);
+		~Importer();
+		
+		void start();
+		void cancel();
+		bool take(TrackInfo &, unsigned long); //NOTE: waits at most the given number of milliseconds for a track
+		bool atEnd();
+		int progress();
+		int unchanged();
+	
+	private:
+		friend class TagReader;
+		bool nextPath(QString &);
+		void put(const TrackInfo &);
+		void skip(bool = false);
+		bool isUnchanged(const QString &, const FileStamp &) const;
+		void readerFinished();
+		
+		DirectoryCrawler *crawler;
+		const FileStamps known;
+		int files_done, files_unchanged, capacity, running_readers;
+		bool canceled;
+		QQueue<TrackInfo> tracks;
+		QMutex mutex;
+		QWaitCondition not_full, not_empty;
+		QList<TagReader *> readers;
+};
+
+class TagReader : public QThread
+{
+	public:
+		TagReader(Importer *);
+	
+	protected:
+		void run();
+	
+	private:
+		Importer *importer;
+};
+
+#endif
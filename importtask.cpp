@@ -0,0 +1,246 @@
+#include "importtask.h"
+#include "profiler.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QSet>
+
+#include <string>
+
+#define qtos(q) (q).toStdString().c_str()
+
+ImportTask::ImportTask() : DatabaseTask("Failed to insert tracks: "), session(0), view_current_track(true), batch_size(500), inserted(0), updated(0), unchanged(0), removed(0), crawler(0), importer(0), canceled(false) {
+}
+
+bool ImportTask::run(sqlite3 *db) {
+	ProfileSpan span("Import tracks");
+	if (!scan_dir.isEmpty() && !QFileInfo(scan_dir).isDir()) //NOTE: an unmounted share would look empty and lose its tracks, its journal row waits for it
+		return true;
+	if (sync_dirs.isEmpty() && session == 0 && !writeJournal(db))
+		return false;
+	TrackWriter writer(db, batch_size);
+	if (sync_dirs.isEmpty()) {
+		FileStamps known;
+		DirectoryCrawler files_crawler(scan_dir.isEmpty() ? QStringList() : QStringList(scan_dir), files);
+		if (!readFileStamps(db, scan_dir.isEmpty() ? stamp_dir : scan_dir, known) || !import(writer, files_crawler, known, !scan_dir.isEmpty()))
+			return false;
+	} else {
+		QString dir;
+		foreach(dir, sync_dirs) {
+			if (!syncDirectory(db, writer, dir))
+				return false;
+		}
+	}
+	failure_msg = "Failed to commit tracks: ";
+	if (!writer.commit())
+		return false;
+	inserted = writer.inserted();
+	updated = writer.updated();
+	removed = writer.removed();
+	{
+		QMutexLocker lock(&mutex);
+		if (session == 0 || canceled) //NOTE: a canceled import stays in the journal
+			return true;
+	}
+	failure_msg = "Failed to write the import journal: ";
+	char *query = sqlite3_mprintf("DELETE FROM `imports` WHERE `session`=%lld", session);
+	bool finished = exec(db, query);
+	sqlite3_free(query);
+	return finished;
+}
+
+int ImportTask::progress() {
+	QMutexLocker lock(&mutex);
+	return importer ? importer->progress() : 0;
+}
+
+int ImportTask::found() {
+	QMutexLocker lock(&mutex);
+	return crawler ? crawler->found() : 0;
+}
+
+void ImportTask::cancel() {
+	QMutexLocker lock(&mutex);
+	canceled = true;
+	if (importer)
+		importer->cancel();
+}
+
+bool ImportTask::writeJournal(sqlite3 *db) {
+	failure_msg = "Failed to write the import journal: ";
+	ProfileSpan span(failure_msg);
+	if (!exec(db, "BEGIN"))
+		return false;
+	char *query = sqlite3_mprintf("INSERT INTO `imports` (`scan_dir`, `stamp_dir`) VALUES (%Q, %Q)", scan_dir.isEmpty() ? 0 : qtos(scan_dir), qtos(stamp_dir));
+	bool written = exec(db, query);
+	sqlite3_free(query);
+	session = sqlite3_last_insert_rowid(db);
+	sqlite3_stmt *stmt = 0;
+	written = written && !sqlite3_prepare_v2(db, "INSERT INTO `import_files` (`session`, `path`) VALUES (?, ?)", -1, &stmt, 0);
+	for (int i = 0; written && i < files.count(); ++i) {
+		std::string path = files.at(i).toStdString(); //NOTE: same conversion as qtos, so the paths match the ones in `tracks`
+		sqlite3_bind_int64(stmt, 1, session);
+		sqlite3_bind_text(stmt, 2, path.c_str(), path.size(), SQLITE_TRANSIENT);
+		written = sqlite3_step(stmt) == SQLITE_DONE;
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (!written || !exec(db, "COMMIT")) {
+		exec(db, "ROLLBACK");
+		session = 0;
+		return false;
+	}
+	return true;
+}
+
+bool ImportTask::readFileStamps(sqlite3 *db, const QString &dir, FileStamps &stamps) {
+	failure_msg = "Failed to Step file stamps in loadFiles: ";
+	ProfileSpan span(failure_msg);
+	char *query = sqlite3_mprintf("SELECT `path`, `size`, `mtime` FROM `tracks` WHERE `path`>='%q/' AND `path`<'%q0'", qtos(dir), qtos(dir)); //NOTE: '0' follows '/', so this is a prefix match that can use the `path` index
+	sqlite3_stmt *stmt = 0;
+	int return_code = sqlite3_prepare_v2(db, query, -1, &stmt, 0);
+	sqlite3_free(query);
+	if (return_code)
+		return false;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		FileStamp stamp;
+		stamp.size = sqlite3_column_int64(stmt, 1);
+		stamp.mtime = sqlite3_column_int64(stmt, 2);
+		stamps.insert(QString((const char *)sqlite3_column_text(stmt, 0)), stamp); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
+	}
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+bool ImportTask::syncDirectory(sqlite3 *db, TrackWriter &writer, const QString &dir) {
+	QFileInfo dir_info(dir);
+	if (dir_info.isDir() && !dir_info.isReadable()) //NOTE: would list as empty, its tracks aren't gone
+		return true;
+	QStringList dir_files, new_subdirs;
+	QSet<QString> subdirs, known_subdirs;
+	{
+		ProfileSpan span("Scan directories");
+		QFileInfoList children = QDir(dir).entryInfoList(QDir::AllEntries | QDir::NoDotAndDotDot);
+		QFileInfoList::const_iterator itt, end = children.constEnd();
+		for (itt = children.constBegin(); itt != end; ++itt) {
+			if (itt->isDir())
+				subdirs.insert(itt->fileName());
+			else
+				dir_files.push_back(itt->absoluteFilePath());
+		}
+	}
+	//NOTE: only the files directly in `dir` and anything under subdirectories that appeared or disappeared is in scope,
+	//the other subdirectories are watched themselves
+	FileStamps known, in_scope;
+	if (!readFileStamps(db, dir, known))
+		return false;
+	FileStamps::const_iterator known_itt, known_end = known.constEnd();
+	for (known_itt = known.constBegin(); known_itt != known_end; ++known_itt) {
+		QString relative_path = known_itt.key().mid(dir.length() + 1);
+		int slash = relative_path.indexOf('/');
+		if (slash != -1) {
+			QString subdir = relative_path.left(slash);
+			known_subdirs.insert(subdir);
+			if (subdirs.contains(subdir))
+				continue;
+		}
+		in_scope.insert(known_itt.key(), known_itt.value());
+	}
+	QString subdir;
+	foreach(subdir, subdirs) {
+		if (!known_subdirs.contains(subdir))
+			new_subdirs.push_back(dir + '/' + subdir);
+	}
+	if (dir_files.isEmpty() && new_subdirs.isEmpty() && in_scope.isEmpty())
+		return true;
+	DirectoryCrawler dir_crawler(new_subdirs, dir_files);
+	return import(writer, dir_crawler, in_scope, true);
+}
+
+bool ImportTask::isUnder(const QString &path, const QStringList &dirs) {
+	QString dir;
+	foreach(dir, dirs) {
+		if (path == dir || path.startsWith(dir.endsWith('/') ? dir : dir + '/'))
+			return true;
+	}
+	return false;
+}
+
+bool ImportTask::import(TrackWriter &writer, DirectoryCrawler &files_crawler, const FileStamps &known, bool remove) {
+	Importer files_importer(&files_crawler, known);
+	{
+		QMutexLocker lock(&mutex);
+		if (canceled)
+			return true;
+		crawler = &files_crawler;
+		importer = &files_importer;
+	}
+	files_crawler.start();
+	files_importer.start();
+	failure_msg = "Failed to insert tracks: ";
+	TrackInfo track;
+	bool written = true;
+	while (written && !files_importer.atEnd()) {
+		bool taken;
+		{
+			ProfileSpan span("Wait for tags"); //NOTE: time the writer spends starved by the TagReaders
+			taken = files_importer.take(track, 50);
+		}
+		if (taken)
+			written = writer.write(track);
+		else
+			written = writer.commit(); //NOTE: a batch isn't held open while the TagReaders catch up, the player's other worker may be waiting to write
+	}
+	bool completed;
+	{
+		QMutexLocker lock(&mutex);
+		crawler = 0;
+		importer = 0;
+		completed = !canceled;
+	}
+	unchanged += files_importer.unchanged();
+	if (!written)
+		return false;
+	if (completed && remove) { //NOTE: a completed scan saw every file it covers but those in directories it couldn't read, anything else known there is gone
+		failure_msg = "Failed to remove tracks: ";
+		QSet<QString> on_disk = files_crawler.files();
+		QStringList unreadable = files_crawler.unreadable();
+		FileStamps::const_iterator itt, end = known.constEnd();
+		for (itt = known.constBegin(); itt != end; ++itt) {
+			if (!on_disk.contains(itt.key()) && !isUnder(itt.key(), unreadable) && !writer.remove(itt.key()))
+				return false;
+		}
+	}
+	return true;
+}
+
+ReadJournalTask::ReadJournalTask() : DatabaseTask("Failed to read the import journal: ") {
+}
+
+ReadJournalTask::~ReadJournalTask() {
+	qDeleteAll(imports);
+}
+
+bool ReadJournalTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `imports`.`session`, `scan_dir`, `stamp_dir`, `path` FROM `imports` LEFT JOIN `import_files` ON `import_files`.`session`=`imports`.`session` ORDER BY `imports`.`session`", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		qint64 session = sqlite3_column_int64(stmt, 0);
+		if (imports.isEmpty() || imports.last()->session != session) {
+			ImportTask *import = new ImportTask;
+			import->session = session;
+			import->scan_dir = QString((const char *)sqlite3_column_text(stmt, 1)); //NOTE: NULL reads as an empty `scan_dir`
+			import->stamp_dir = QString((const char *)sqlite3_column_text(stmt, 2));
+			import->view_current_track = false; //NOTE: resumed behind whatever is being browsed, don't jump away from it
+			imports.push_back(import);
+		}
+		if (sqlite3_column_type(stmt, 3) != SQLITE_NULL)
+			imports.last()->files.push_back(QString((const char *)sqlite3_column_text(stmt, 3)));
+	}
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
@@ -0,0 +1,66 @@
+#ifndef _IMPORTTASK_H_
+#define _IMPORTTASK_H_
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+
+#include "databaseworker.h"
+#include "directorycrawler.h"
+#include "importer.h"
+#include "trackwriter.h"
+
+/*
+ * Reads tags with an Importer and writes them with a TrackWriter, either for a list of files, for a directory
+ * walked by a DirectoryCrawler or for directories the library watch saw change.  The GUI polls progress()
+ * and found() while it runs, the files are still being found while their tags are read.  An import of files or
+ * of a directory is written to the journal before it starts and taken out once it has seen every file, one
+ * that is canceled or cut short is resumed from there, the stamps of the files it wrote make it skip them.
+ * It runs for as long as the files take, so it is posted to a DatabaseWorker of its own, and a batch is
+ * committed early whenever it has to wait for tags, so the write lock is never held across a wait.
+ */
+class ImportTask : public DatabaseTask
+{
+	public:
+		ImportTask();
+		
+		bool run(sqlite3 *);
+		int progress();
+		int found();
+		void cancel();
+		
+		QStringList files, sync_dirs; //NOTE: `files` are imported against the stamps under `stamp_dir`, each of `sync_dirs` is rescanned
+		QString stamp_dir, scan_dir; //NOTE: `scan_dir` is walked instead, and its known tracks that weren't found are removed
+		qint64 session; //NOTE: the journal row, 0 until it has been written
+		bool view_current_track;
+		int batch_size, inserted, updated, unchanged, removed;
+	
+	private:
+		bool writeJournal(sqlite3 *);
+		bool readFileStamps(sqlite3 *, const QString &, FileStamps &);
+		bool syncDirectory(sqlite3 *, TrackWriter &, const QString &);
+		bool import(TrackWriter &, DirectoryCrawler &, const FileStamps &, bool);
+		static bool isUnder(const QString &, const QStringList &);
+		
+		DirectoryCrawler *crawler;
+		Importer *importer;
+		bool canceled;
+		QMutex mutex;
+};
+
+/*
+ * Reads the import journal into an ImportTask per import that didn't finish, for the GUI to post again.
+ */
+class ReadJournalTask : public DatabaseTask
+{
+	public:
+		ReadJournalTask();
+		~ReadJournalTask();
+		
+		bool run(sqlite3 *);
+		
+		QList<ImportTask *> imports; //NOTE: owned until the GUI takes them
+};
+
+#endif
@@ -0,0 +1,65 @@
+#include "lengthscanner.h"
+
+#include <QMutexLocker>
+
+#include <taglib/audioproperties.h>
+#include <taglib/fileref.h>
+
+#ifdef Q_OS_LINUX
+#include <unistd.h>
+#include <sys/syscall.h>
+#define IOPRIO_WHO_PROCESS 1 //NOTE: glibc has no wrapper or header for ioprio_set, these come from linux/ioprio.h
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+#endif
+
+LengthScanner::LengthScanner(const QList<int> &tids, const QStringList &paths, int batch_size, QObject *parent) : QThread(parent), tids(tids), paths(paths), batch_size(qMax(batch_size, 1)), paused(false), stopped(false) {
+}
+
+LengthScanner::~LengthScanner() {
+	stop();
+	wait();
+}
+
+void LengthScanner::setPaused(bool pause) {
+	QMutexLocker lock(&mutex);
+	paused = pause;
+	if (!paused)
+		unpaused.wakeAll();
+}
+
+void LengthScanner::stop() {
+	QMutexLocker lock(&mutex);
+	stopped = true;
+	unpaused.wakeAll();
+}
+
+QList<TrackLength> LengthScanner::take() {
+	QMutexLocker lock(&mutex);
+	QList<TrackLength> batch = lengths;
+	lengths.clear();
+	return batch;
+}
+
+void LengthScanner::run() {
+#ifdef Q_OS_LINUX
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT); //NOTE: 0 is the calling thread, the disk is only read when nothing else wants it
+#endif
+	for (int i = 0; i < tids.count(); ++i) {
+		if (!waitWhilePaused())
+			return;
+		TagLib::FileRef f(paths.at(i).toUtf8().constData(), true, TagLib::AudioProperties::Fast);
+		int length = !f.isNull() && f.audioProperties() ? f.audioProperties()->length() : 0; //NOTE: 0 keeps unreadable files from being scanned again on every start
+		QMutexLocker lock(&mutex);
+		lengths.push_back(TrackLength(tids.at(i), length));
+		if (lengths.count() == batch_size || i == tids.count() - 1)
+			emit lengthsRead();
+	}
+}
+
+bool LengthScanner::waitWhilePaused() {
+	QMutexLocker lock(&mutex);
+	while (paused && !stopped)
+		unpaused.wait(&mutex);
+	return !stopped;
+}
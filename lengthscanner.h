@@ -0,0 +1,48 @@
+#ifndef _LENGTHSCANNER_H_
+#define _LENGTHSCANNER_H_
+
+#include <QList>
+#include <QMutex>
+#include <QPair>
+#include <QStringList>
+#include <QThread>
+#include <QWaitCondition>
+
+typedef QPair<int, int> TrackLength; //NOTE: `tid`, length in seconds
+
+/*
+ * Reads the length of tracks that were imported before lengths were read at import time, on one thread at
+ * idle CPU and I/O priority.  The lengths are handed back in batches through lengthsRead(), the DatabaseWorker
+ * stays the only writer to the database.  The scanner is paused while an import or a seek is in progress.
+ */
+class LengthScanner : public QThread
+{
+	Q_OBJECT
+	
+	public:
+		LengthScanner(const QList<int> &, const QStringList &, int = 100, QObject * = 0);
+		~LengthScanner();
+		
+		void setPaused(bool);
+		void stop();
+		QList<TrackLength> take();
+	
+	signals:
+		void lengthsRead();
+	
+	protected:
+		void run();
+	
+	private:
+		bool waitWhilePaused();
+		
+		QList<int> tids;
+		QStringList paths;
+		QList<TrackLength> lengths;
+		int batch_size;
+		bool paused, stopped;
+		QMutex mutex;
+		QWaitCondition unpaused;
+};
+
+#endif
@@ -0,0 +1,307 @@
+#include "libraryindex.h"
+#include "profiler.h"
+
+#include <QFile>
+
+#include <KSaveFile>
+
+#include <string.h>
+
+const quint32 SNAPSHOT_MAGIC = 0x50375331; //NOTE: "P7S1", also tells a snapshot written with the other byte order apart
+const quint32 SNAPSHOT_VERSION = 1;
+
+/*
+ * SNAPSHOT FORMAT:
+ *  a SnapshotHeader, then the arrays as native 32 bit integers in the order they are declared in, the
+ *  `artist_albums` and `album_tracks` arrays with their sentinel, then each string list as count + 1
+ *  offsets into the UTF-16 text that follows them, padded to 4 bytes
+ */
+struct SnapshotHeader {
+	quint32 magic, version;
+	qint64 generation;
+	qint32 num_tracks, num_artists, num_albums, reserved;
+};
+
+static bool writeInts(QIODevice &file, const QVector<int> &values) {
+	qint64 size = values.count() * sizeof(qint32);
+	return file.write((const char *)values.constData(), size) == size;
+}
+
+static bool writeStrings(QIODevice &file, const QStringList &strings) {
+	QVector<int> offsets;
+	offsets.reserve(strings.count() + 1);
+	QString text;
+	QString string;
+	foreach(string, strings) {
+		offsets.push_back(text.length());
+		text += string;
+	}
+	offsets.push_back(text.length());
+	if (text.length() % 2)
+		text += QChar(0); //NOTE: keeps the next list aligned
+	qint64 size = text.length() * sizeof(QChar);
+	return writeInts(file, offsets) && file.write((const char *)text.constData(), size) == size;
+}
+
+static bool readInts(const uchar *&data, const uchar *end, int count, QVector<int> &values) {
+	if (count < 0 || (end - data) / (qint64)sizeof(qint32) < count)
+		return false;
+	values.resize(count);
+	memcpy(values.data(), data, count * sizeof(qint32));
+	data += count * sizeof(qint32);
+	return true;
+}
+
+static bool readStrings(const uchar *&data, const uchar *end, int count, QStringList &strings) {
+	QVector<int> offsets;
+	if (!readInts(data, end, count + 1, offsets))
+		return false;
+	int length = offsets.last() + offsets.last() % 2;
+	if (offsets.first() != 0 || length < 0 || (end - data) / (qint64)sizeof(QChar) < length)
+		return false;
+	const QChar *text = (const QChar *)data;
+	strings.clear();
+	strings.reserve(count);
+	for (int i = 0; i < count; ++i) {
+		if (offsets.at(i) > offsets.at(i + 1))
+			return false;
+		strings.push_back(QString(text + offsets.at(i), offsets.at(i + 1) - offsets.at(i)));
+	}
+	data += length * sizeof(QChar);
+	return true;
+}
+
+static bool inRange(const QVector<int> &values, int last) {
+	int value;
+	foreach(value, values) {
+		if (value < 0 || value > last)
+			return false;
+	}
+	return true;
+}
+
+LibraryIndex::LibraryIndex() {
+	clear();
+}
+
+bool LibraryIndex::load(sqlite3 *db) {
+	ProfileSpan span("Failed to load the library index: ");
+	const char *query = "SELECT `tid`, `artist_id`, `artists`.`name`, `album_id`, `albums`.`name`, `tracks`.`year`, `track_number`, `title`, `path` FROM `tracks` "
+	                    "JOIN `artists` ON `artist_id`=`artists`.`aid` JOIN `albums` ON `album_id`=`alid` "
+	                    "ORDER BY `artists`.`name`, `artist_id`, `albums`.`year`, `albums`.`name`, `album_id`, `track_number`, `tid`";
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, query, -1, &stmt, 0))
+		return false;
+	clear();
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int position = tids.count();
+		int aid = sqlite3_column_int(stmt, 1);
+		int alid = sqlite3_column_int(stmt, 3);
+		if (artist_ids.isEmpty() || artist_ids.last() != aid) {
+			artist_albums.insert(artist_albums.count() - 1, album_ids.count());
+			aid_artists.insert(aid, artist_ids.count());
+			artist_ids.push_back(aid);
+			artist_names.push_back(QString((const char *)sqlite3_column_text(stmt, 2))); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
+		}
+		if (album_ids.isEmpty() || album_ids.last() != alid) {
+			album_tracks.insert(album_tracks.count() - 1, position);
+			alid_albums.insert(alid, album_ids.count());
+			album_ids.push_back(alid);
+			album_names.push_back(QString((const char *)sqlite3_column_text(stmt, 4)));
+		}
+		int tid = sqlite3_column_int(stmt, 0);
+		tid_positions.insert(tid, position);
+		tids.push_back(tid);
+		track_artists.push_back(artist_ids.count() - 1);
+		track_albums.push_back(album_ids.count() - 1);
+		years.push_back(sqlite3_column_int(stmt, 5));
+		track_numbers.push_back(sqlite3_column_int(stmt, 6));
+		titles.push_back(QString((const char *)sqlite3_column_text(stmt, 7)));
+		paths.push_back(QString((const char *)sqlite3_column_text(stmt, 8)));
+	}
+	sqlite3_finalize(stmt);
+	artist_albums.last() = album_ids.count();
+	album_tracks.last() = tids.count();
+	return return_code == SQLITE_DONE;
+}
+
+bool LibraryIndex::writeSnapshot(const QString &path, qint64 generation) const {
+	ProfileSpan span("Write library snapshot");
+	KSaveFile file(path); //NOTE: written next to the old snapshot and renamed over it, a reader never sees half a snapshot
+	if (!file.open())
+		return false;
+	SnapshotHeader header = {SNAPSHOT_MAGIC, SNAPSHOT_VERSION, generation, tids.count(), artist_ids.count(), album_ids.count(), 0};
+	if (file.write((const char *)&header, sizeof(header)) != (qint64)sizeof(header) ||
+	    !writeInts(file, tids) || !writeInts(file, track_artists) || !writeInts(file, track_albums) || !writeInts(file, years) || !writeInts(file, track_numbers) ||
+	    !writeInts(file, artist_ids) || !writeInts(file, artist_albums) || !writeInts(file, album_ids) || !writeInts(file, album_tracks) ||
+	    !writeStrings(file, artist_names) || !writeStrings(file, album_names) || !writeStrings(file, titles) || !writeStrings(file, paths)) {
+		file.abort();
+		return false;
+	}
+	return file.finalize();
+}
+
+bool LibraryIndex::readSnapshot(const QString &path, qint64 &generation) {
+	ProfileSpan span("Read library snapshot");
+	QFile file(path);
+	if (!file.open(QIODevice::ReadOnly) || file.size() < (qint64)sizeof(SnapshotHeader))
+		return false;
+	uchar *map = file.map(0, file.size());
+	if (!map)
+		return false;
+	const uchar *data = map, *end = map + file.size();
+	SnapshotHeader header;
+	memcpy(&header, data, sizeof(header));
+	data += sizeof(header);
+	bool valid = header.magic == SNAPSHOT_MAGIC && header.version == SNAPSHOT_VERSION &&
+	             readInts(data, end, header.num_tracks, tids) && readInts(data, end, header.num_tracks, track_artists) && readInts(data, end, header.num_tracks, track_albums) &&
+	             readInts(data, end, header.num_tracks, years) && readInts(data, end, header.num_tracks, track_numbers) &&
+	             readInts(data, end, header.num_artists, artist_ids) && readInts(data, end, header.num_artists + 1, artist_albums) &&
+	             readInts(data, end, header.num_albums, album_ids) && readInts(data, end, header.num_albums + 1, album_tracks) &&
+	             readStrings(data, end, header.num_artists, artist_names) && readStrings(data, end, header.num_albums, album_names) &&
+	             readStrings(data, end, header.num_tracks, titles) && readStrings(data, end, header.num_tracks, paths) &&
+	             inRange(track_artists, header.num_artists - 1) && inRange(track_albums, header.num_albums - 1) && //NOTE: a damaged snapshot must not index out of the arrays
+	             inRange(artist_albums, header.num_albums) && inRange(album_tracks, header.num_tracks) &&
+	             artist_albums.last() == header.num_albums && album_tracks.last() == header.num_tracks;
+	file.unmap(map);
+	if (!valid) {
+		clear();
+		return false;
+	}
+	tid_positions.clear();
+	aid_artists.clear();
+	alid_albums.clear();
+	tid_positions.reserve(tids.count());
+	for (int position = 0; position < tids.count(); ++position)
+		tid_positions.insert(tids.at(position), position);
+	for (int artist = 0; artist < artist_ids.count(); ++artist)
+		aid_artists.insert(artist_ids.at(artist), artist);
+	for (int album = 0; album < album_ids.count(); ++album)
+		alid_albums.insert(album_ids.at(album), album);
+	generation = header.generation;
+	return true;
+}
+
+int LibraryIndex::count() const {
+	return tids.count();
+}
+
+bool LibraryIndex::contains(int tid) const {
+	return tid_positions.contains(tid);
+}
+
+int LibraryIndex::position(int tid) const {
+	return tid_positions.value(tid, -1);
+}
+
+int LibraryIndex::tid(int position) const {
+	return tids.at(position);
+}
+
+int LibraryIndex::following(int tid) const {
+	int next = position(tid) + 1; //NOTE: an unknown `tid` starts over from the first track
+	return tids.at(next < tids.count() ? next : 0);
+}
+
+int LibraryIndex::artistOf(int position) const {
+	return track_artists.at(position);
+}
+
+int LibraryIndex::albumOf(int position) const {
+	return track_albums.at(position);
+}
+
+int LibraryIndex::year(int position) const {
+	return years.at(position);
+}
+
+int LibraryIndex::trackNumber(int position) const {
+	return track_numbers.at(position);
+}
+
+QString LibraryIndex::title(int position) const {
+	return titles.at(position);
+}
+
+QString LibraryIndex::path(int position) const {
+	return paths.at(position);
+}
+
+int LibraryIndex::numArtists() const {
+	return artist_ids.count();
+}
+
+int LibraryIndex::artistIndex(int aid) const {
+	return aid_artists.value(aid, -1);
+}
+
+int LibraryIndex::artistId(int artist) const {
+	return artist_ids.at(artist);
+}
+
+QString LibraryIndex::artistName(int artist) const {
+	return artist_names.at(artist);
+}
+
+int LibraryIndex::firstAlbum(int artist) const {
+	return artist_albums.at(artist);
+}
+
+int LibraryIndex::albumIndex(int alid) const {
+	return alid_albums.value(alid, -1);
+}
+
+int LibraryIndex::albumId(int album) const {
+	return album_ids.at(album);
+}
+
+QString LibraryIndex::albumName(int album) const {
+	return album_names.at(album);
+}
+
+int LibraryIndex::firstTrack(int album) const {
+	return album_tracks.at(album);
+}
+
+void LibraryIndex::artists(QVector<int> &ids, QStringList &names) const {
+	ids = artist_ids;
+	names = artist_names;
+}
+
+void LibraryIndex::albums(int artist, QVector<int> &ids, QStringList &names, const QSet<int> *only) const {
+	for (int album = artist_albums.at(artist); album < artist_albums.at(artist + 1); ++album) {
+		if (only && !only->contains(album))
+			continue;
+		ids.push_back(album_ids.at(album));
+		names.push_back(album_names.at(album));
+	}
+}
+
+void LibraryIndex::tracks(int album, QVector<int> &ids, QStringList &texts, const QSet<int> *only) const {
+	for (int position = album_tracks.at(album); position < album_tracks.at(album + 1); ++position) {
+		if (only && !only->contains(tids.at(position)))
+			continue;
+		ids.push_back(tids.at(position));
+		texts.push_back(QString("%1. %2").arg(track_numbers.at(position)).arg(titles.at(position)));
+	}
+}
+
+void LibraryIndex::clear() {
+	tids.clear();
+	track_artists.clear();
+	track_albums.clear();
+	years.clear();
+	track_numbers.clear();
+	titles.clear();
+	paths.clear();
+	artist_ids.clear();
+	artist_albums.fill(0, 1);
+	artist_names.clear();
+	album_ids.clear();
+	album_tracks.fill(0, 1);
+	album_names.clear();
+	tid_positions.clear();
+	aid_artists.clear();
+	alid_albums.clear();
+}
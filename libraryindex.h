@@ -0,0 +1,70 @@
+#ifndef _LIBRARYINDEX_H_
+#define _LIBRARYINDEX_H_
+
+#include <QHash>
+#include <QSet>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include <sqlite3.h>
+
+/*
+ * The whole library held as parallel arrays, one entry per track, sorted in play order (artist, album by year,
+ * track number).  Artists and albums are interned into their own arrays, so the tracks of an album and the
+ * albums of an artist are contiguous ranges and navigation never needs SQL or a walk over the list widgets.
+ *  position: index of a track in play order
+ *  artist:   index of an artist in the artist column (without the [All] row)
+ *  album:    index of an album in play order, the albums of an artist are consecutive
+ * The arrays are also written to a snapshot file after every load, which is mapped at startup so the columns
+ * can be filled before the database is open.
+ */
+class LibraryIndex
+{
+	public:
+		LibraryIndex();
+		
+		bool load(sqlite3 *);
+		bool writeSnapshot(const QString &, qint64) const;
+		bool readSnapshot(const QString &, qint64 &); //NOTE: sets the `library_generation` the snapshot was written at
+		
+		int count() const;
+		bool contains(int) const;
+		int position(int) const;
+		int tid(int) const;
+		int following(int) const; //NOTE: the `tid` after the given one in play order, wrapping around
+		int artistOf(int) const;
+		int albumOf(int) const;
+		int year(int) const; //NOTE: the track's own, albums are ordered by the earliest year of their tracks
+		int trackNumber(int) const;
+		QString title(int) const;
+		QString path(int) const;
+		
+		int numArtists() const;
+		int artistIndex(int) const;
+		int artistId(int) const;
+		QString artistName(int) const;
+		int firstAlbum(int) const;
+		
+		int albumIndex(int) const;
+		int albumId(int) const;
+		QString albumName(int) const;
+		int firstTrack(int) const;
+		
+		void artists(QVector<int> &, QStringList &) const;
+		void albums(int, QVector<int> &, QStringList &, const QSet<int> * = 0) const; //NOTE: only the albums in the set, when there is one
+		void tracks(int, QVector<int> &, QStringList &, const QSet<int> * = 0) const; //NOTE: only the `tid`s in the set, when there is one
+	
+	private:
+		void clear();
+		
+		QVector<int> tids, track_artists, track_albums, years, track_numbers; //NOTE: indexed by position
+		QStringList titles, paths;
+		QVector<int> artist_ids, artist_albums; //NOTE: indexed by artist, `artist_albums` has a trailing sentinel
+		QStringList artist_names;
+		QVector<int> album_ids, album_tracks; //NOTE: indexed by album, `album_tracks` has a trailing sentinel
+		QStringList album_names;
+		QHash<int, int> tid_positions, aid_artists, alid_albums;
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "loadlibrarytask.h"
+#include "profiler.h"
+
+LoadLibraryTask::LoadLibraryTask(DatabaseWorker *database, const QString &snapshot_path, Reselect reselect) : DatabaseTask("Failed to read the library generation: "), snapshot_path(snapshot_path), snapshot_generation(-1), generation(-1), snapshot_current(false), shuffle_bag(database), reselect(reselect), aid(0), position(-1), delete_level(TrackLevel), artist_row(0), album_row(0), title_row(0) {
+}
+
+bool LoadLibraryTask::run(sqlite3 *db) {
+	sqlite3_stmt *stmt = 0;
+	int return_code;
+	{
+		ProfileSpan span(failure_msg);
+		if (sqlite3_prepare_v2(db, "SELECT `generation` FROM `library_generation`", -1, &stmt, 0))
+			return false;
+		return_code = sqlite3_step(stmt);
+		if (return_code == SQLITE_ROW)
+			generation = sqlite3_column_int64(stmt, 0);
+		sqlite3_finalize(stmt);
+	}
+	if (return_code != SQLITE_ROW)
+		return false;
+	snapshot_current = generation == snapshot_generation;
+	if (!snapshot_current) {
+		failure_msg = "Failed to load the library index: ";
+		if (!library.load(db))
+			return false;
+		library.writeSnapshot(snapshot_path, generation); //NOTE: a snapshot that couldn't be written only means the next start waits for the database
+	}
+	failure_msg = "Failed to load the shuffle bag: ";
+	QList<int> imported;
+	for (int position = 0; reselect != Startup && position < library.count(); ++position) {
+		if (!previous.contains(library.tid(position)))
+			imported.push_back(library.tid(position));
+	}
+	if (reselect == Startup || imported.count() > library.count() / 8) { //NOTE: one scan of the shuffle index beats a lookup per track
+		if (!shuffle_bag.load(db))
+			return false;
+	}
+	else if (!shuffle_bag.loadTracks(db, imported))
+		return false;
+	if (reselect != Startup)
+		return true;
+	failure_msg = "Failed to load the track queue: ";
+	if (!track_queue.load(db))
+		return false;
+	failure_msg = "Failed to load the play history: ";
+	return history.load(db);
+}
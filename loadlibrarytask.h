@@ -0,0 +1,41 @@
+#ifndef _LOADLIBRARYTASK_H_
+#define _LOADLIBRARYTASK_H_
+
+#include <QList>
+#include <QString>
+
+#include "databaseworker.h"
+#include "libraryindex.h"
+#include "shufflebag.h"
+#include "trackhistory.h"
+#include "trackqueue.h"
+
+enum DeleteLevel {AllTracksLevel, ArtistLevel, AlbumLevel, TrackLevel}; //NOTE: what a delete removed, the selection a Rows reload restores depends on it
+
+/*
+ * Loads a new LibraryIndex and ShuffleBag for reloadLibrary(), and carries what to select once they are in.
+ * Every index it loads is also written to the library snapshot, the one in memory is left alone when it was
+ * read from a snapshot that is still current.
+ */
+class LoadLibraryTask : public DatabaseTask
+{
+	public:
+		enum Reselect {Startup, CurrentTrack, Artist, Rows};
+		
+		LoadLibraryTask(DatabaseWorker *, const QString &, Reselect);
+		
+		bool run(sqlite3 *);
+		
+		QString snapshot_path;
+		qint64 snapshot_generation, generation; //NOTE: `snapshot_generation` is that of the snapshot shown at startup, -1 for none
+		bool snapshot_current;
+		LibraryIndex library, previous; //NOTE: `previous` is the index in memory when the task was posted
+		ShuffleBag shuffle_bag; //NOTE: the whole bag at Startup, afterwards the tracks `previous` lacks
+		TrackQueue track_queue; //NOTE: Startup only, later loads leave the queue and history in memory alone
+		TrackHistory history;
+		Reselect reselect;
+		int aid; //NOTE: Artist
+		int position, delete_level, artist_row, album_row, title_row; //NOTE: Rows, the selection when the tracks were deleted
+};
+
+#endif
@@ -1,11 +1,16 @@
 #include "player.h"
+#include "browsemodel.h"
+#include "importtask.h"
+#include "loadlibrarytask.h"
+#include "profiler.h"
+#include "statswindow.h"
+#include "trackwriter.h"
 
 #include <QDateTime>
 #include <QFileInfo>
 #include <QGridLayout>
 #include <QHBoxLayout>
 #include <QKeyEvent>
-#include <QProgressDialog>
 #include <QVBoxLayout>
 
 #include <KActionCollection>
@@ -27,9 +32,6 @@
 #include <phonon/seekslider.h>
 #include <phonon/volumeslider.h>
 
-#include <taglib/tag.h>
-#include <taglib/fileref.h>
-
 #define qtos(q) (q).toStdString().c_str()
 #define qsnb(q) (q).toUtf8().size()
 #define formatTime(t) ((t) / 60000) << ':' << qSetFieldWidth(2) << qSetPadChar('0') << right << ((t) / 1000) % 60
@@ -38,35 +40,107 @@ const int SONG_NAME   = 0;
 const char *ALL = "[All]";
 
 /*
- * TABLE DEF:
- *  col   Name          Type      Key
- *  0     tid           INTEGER   PRIMARY ASC
- *  1     artist        VARCHAR   ASC
- *  2     year          INT       ASC
- *  3     album         VARCHAR
- *  4     track_number  INT       ASC
- *  5     title         VARCHAR
- *  6     path          VARCHAR
+ * Finds the tracks the LengthScanner has to read.
+ */
+class MissingLengthsTask : public DatabaseTask
+{
+	public:
+		MissingLengthsTask();
+		
+		bool run(sqlite3 *);
+		
+		QList<int> tids;
+		QStringList paths;
+};
+
+/*
+ * Writes a batch of lengths read by the LengthScanner.
+ */
+class LengthsTask : public DatabaseTask
+{
+	public:
+		LengthsTask(const QList<TrackLength> &);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QList<TrackLength> lengths;
+};
+
+/*
+ * Adds the plays counted since the last flush to `playcount`.
  */
+class PlaycountsTask : public DatabaseTask
+{
+	public:
+		PlaycountsTask(const QHash<int, int> &);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QHash<int, int> plays;
+};
+
+MissingLengthsTask::MissingLengthsTask() : DatabaseTask("Failed to Step lengths in startLengthScanner: ") {
+}
+
+bool MissingLengthsTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `tid`, `path` FROM `tracks` WHERE `length` IS NULL", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		tids.push_back(sqlite3_column_int(stmt, 0));
+		paths.push_back(QString((const char *)sqlite3_column_text(stmt, 1)));
+	}
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+LengthsTask::LengthsTask(const QList<TrackLength> &lengths) : DatabaseTask("Failed to write track lengths: "), lengths(lengths) {
+}
+
+bool LengthsTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	TrackWriter writer(db);
+	TrackLength length;
+	foreach(length, lengths) {
+		if (!writer.writeLength(length.first, length.second))
+			return false;
+	}
+	return writer.commit();
+}
+
+PlaycountsTask::PlaycountsTask(const QHash<int, int> &plays) : DatabaseTask("Failed to write play counts: "), plays(plays) {
+}
+
+bool PlaycountsTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	TrackWriter writer(db);
+	QHash<int, int>::const_iterator itt, end = plays.constEnd();
+	for (itt = plays.constBegin(); itt != end; ++itt) {
+		if (!writer.addPlays(itt.key(), itt.value()))
+			return false;
+	}
+	return writer.commit();
+}
 
 Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
+	//SETUP PROFILER
+	Profiler::setRecording(!qgetenv("PROJEKT7_PROFILE").isEmpty()); //NOTE: before anything starts, so startup is recorded too
+	
 	//SETUP DATABASE
 	QDir(KGlobal::dirs()->saveLocation("data")).mkdir("projekt7"); //NOTE: creates the projekt7 directory if it doesn't already exist
 	QString db_path = KGlobal::dirs()->saveLocation("data") + "projekt7/tracks_db";
-	int return_code = sqlite3_open(qtos(db_path), &tracks_db);
-	if (return_code) {
-		showError("Failed to open the Projekt7 Track Database: ", sqlite3_errmsg(tracks_db));
-		exit(return_code);
-	}
-	const char *create_table = "CREATE TABLE IF NOT EXISTS `tracks` (`tid` INTEGER PRIMARY KEY, `artist` VARCHAR KEY ASC, `year` INT KEY ASC, `album` VARCHAR, `track_number` INT KEY ASC, `title` VARCHAR, `path` VARCHAR, `length` INT, `playcount` INT)"; //TODO make use of the `length` and `playcount` columns
-	char *errmsg;
-	return_code = sqlite3_exec(tracks_db, create_table, 0, 0, &errmsg);
-	if (return_code) {
-		showError("Failed to create `tracks` table: ", errmsg);
-		sqlite3_free(errmsg);
-		exit(return_code);
-	}
-	updateNumTracks();
+	snapshot_path = KGlobal::dirs()->saveLocation("data") + "projekt7/library_snapshot";
+	database = new DatabaseWorker(db_path, this); //NOTE: opens the database and brings its schema up to date on its own thread
+	connect(database, SIGNAL(error(const QString &, const QString &)), this, SLOT(fatalError(const QString &, const QString &)));
+	database->start();
+	import_database = new DatabaseWorker(db_path, this); //NOTE: imports write on a connection of their own, the browse columns, stats and play counts don't queue behind them
+	connect(import_database, SIGNAL(error(const QString &, const QString &)), this, SLOT(fatalError(const QString &, const QString &)));
+	track_queue = TrackQueue(database); //NOTE: empty until the saved queue and history are restored along with the library
+	history = TrackHistory(database);
 	
 	//SETUP PHONON
 	now_playing = new Phonon::MediaObject(this);
@@ -79,10 +153,12 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	KToolBar *toolbar_widget = new KToolBar(i18n("Main Toolbar"), central_widget);
 	toolbar_widget->setIconDimensions(32);
 	playlist_widget = new QWidget(central_widget);
-	artist_list = new KListWidget(playlist_widget);
-	artist_list->addItem(ALL);
-	album_list = new KListWidget(playlist_widget);
-	titles_list = new KListWidget(playlist_widget);
+	artist_model = new BrowseModel(database, "`artist`", ALL, this);
+	album_model = new BrowseModel(database, "`album`", ALL, this);
+	titles_model = new BrowseModel(database, "`title`", QString(), this);
+	artist_list = setupListView(artist_model, playlist_widget);
+	album_list = setupListView(album_model, playlist_widget);
+	titles_list = setupListView(titles_model, playlist_widget);
 	QAction* tb_previousAction = toolbar_widget->addAction(KIcon("media-skip-backward"), "");
 	QString previousHelpText = i18n("Play the previous track");
 	tb_previousAction->setToolTip(previousHelpText);
@@ -113,12 +189,20 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	track_duration->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Fixed);
 	toolbar_widget->addWidget(track_duration);
 	queued = new KIcon("go-next-view");
+	titles_model->setQueuedIcon(&track_queue, *queued);
+	
+	search_edit = new KLineEdit(playlist_widget);
+	search_edit->setClickMessage(i18n("Search artists, albums and titles"));
+	search_edit->setClearButtonShown(true);
 	
 	QHBoxLayout *listLayout = new QHBoxLayout;
 	listLayout->addWidget(artist_list);
 	listLayout->addWidget(album_list);
 	listLayout->addWidget(titles_list);
-	playlist_widget->setLayout(listLayout);
+	QVBoxLayout *playlistLayout = new QVBoxLayout;
+	playlistLayout->addWidget(search_edit);
+	playlistLayout->addLayout(listLayout);
+	playlist_widget->setLayout(playlistLayout);
 	
 	QVBoxLayout *mainLayout = new QVBoxLayout;
 	mainLayout->addWidget(toolbar_widget);
@@ -131,6 +215,15 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	KStatusBar* bar = statusBar();
 	bar->insertPermanentItem("", SONG_NAME, true);
 	bar->setItemAlignment(SONG_NAME, Qt::AlignLeft | Qt::AlignVCenter);
+	import_progress = new QProgressBar(bar);
+	import_progress->setFormat("%v / %m files");
+	import_progress->setMaximumWidth(200);
+	import_progress->hide();
+	import_cancel_button = new KPushButton(KIcon("process-stop"), "", bar);
+	import_cancel_button->setToolTip("Cancel the import, it is resumed at the next start");
+	import_cancel_button->hide();
+	bar->addPermanentWidget(import_progress);
+	bar->addPermanentWidget(import_cancel_button);
 	
 	//SETUP SYSTEM TRAY ICON
 	tray_icon = new KSystemTrayIcon("projekt7", this);
@@ -156,7 +249,10 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	mwLayout->addWidget(mw_track_number = new QLabel(metadata_window), 3, 1);
 	mwLayout->addWidget(mw_title        = new QLabel(metadata_window), 4, 1);
 	mwLayout->addWidget(mw_path         = new QLabel(metadata_window), 5, 1);
-	mwLayout->addWidget(mw_ok_button, 6, 0, 1, 2, Qt::AlignCenter);
+	mwLayout->addWidget(mw_cover        = new QLabel(metadata_window), 0, 2, 6, 1, Qt::AlignCenter);
+	mwLayout->addWidget(mw_ok_button, 6, 0, 1, 3, Qt::AlignCenter);
+	mw_cover->setMinimumSize(CoverCache::Large, CoverCache::Large);
+	mw_alid = 0;
 	metadata_window->setLayout(mwLayout);
 	
 	//SETUP QUEUE EDITOR WINDOW
@@ -192,18 +288,64 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	qwLayout->addWidget(qw_ok_button, 0, Qt::AlignCenter);
 	queue_window->setLayout(qwLayout);
 	
+	//SETUP STATISTICS WINDOW
+	stats_window = new StatsWindow(database, this);
+	
+	//SETUP PROFILER WINDOW
+	profile_window = new ProfileWindow(this);
+	
+	//SETUP LIBRARY WATCH
+	importing = 0;
+	import_timer = new QTimer(this);
+	import_timer->setInterval(100);
+	library_watch = new KDirWatch(this);
+	sync_timer = new QTimer(this);
+	sync_timer->setSingleShot(true);
+	sync_timer->setInterval(2000);
+	length_scanner = 0;
+	
+	//SETUP PLAY COUNTING
+	playing_tid = 0;
+	next_track.tid = 0;
+	play_counted = true;
+	cur_duration = 0;
+	playcount_timer = new QTimer(this);
+	
+	//SETUP LOOKAHEAD
+	lookahead_depth = 3;
+	lookahead_timer = new QTimer(this);
+	lookahead_timer->setSingleShot(true);
+	lookahead_timer->setInterval(0); //NOTE: resolves after the event that changed the track has been handled, never inside aboutToFinish
+	
+	//SETUP SEARCH
+	searching = false;
+	search_worker = 0;
+	pending_title_row = -1;
+	search_timer = new QTimer(this);
+	search_timer->setSingleShot(true);
+	search_timer->setInterval(250); //NOTE: waits for a pause in typing instead of searching on every key
+	
 	//SETUP ACTIONS
  	KStandardAction::quit(kapp, SLOT(quit()), actionCollection());
 	connect(kapp, SIGNAL(aboutToQuit()), this, SLOT(quit()));
 	connect(now_playing, SIGNAL(aboutToFinish()), this, SLOT(enqueueNext()));
 	connect(now_playing, SIGNAL(totalTimeChanged(qint64)), this, SLOT(updateDuration(qint64)));
 	connect(now_playing, SIGNAL(tick(qint64)), this, SLOT(tick(qint64)));
+	connect(now_playing, SIGNAL(stateChanged(Phonon::State, Phonon::State)), this, SLOT(playbackStateChanged(Phonon::State)));
+	connect(now_playing, SIGNAL(currentSourceChanged(const Phonon::MediaSource &)), this, SLOT(sourceChanged()));
+	connect(playcount_timer, SIGNAL(timeout()), this, SLOT(flushPlaycounts()));
+	connect(lookahead_timer, SIGNAL(timeout()), this, SLOT(fillLookahead()));
+	connect(search_edit, SIGNAL(textChanged(const QString &)), search_timer, SLOT(start()));
+	connect(search_timer, SIGNAL(timeout()), this, SLOT(startSearch()));
+	KStandardAction::find(search_edit, SLOT(setFocus()), actionCollection());
 	KAction *openFilesAction = setupKAction("document-open", i18n("Open"), i18n("Load the selected files"), "files");
 	openFilesAction->setShortcut(QKeySequence::Open);
 	connect(openFilesAction, SIGNAL(triggered(bool)), this, SLOT(loadFiles()));
 	KAction *openDirectoryAction = setupKAction("document-open-folder", i18n("Open Directory..."), i18n("Load all files in the selected directory and its subdirectories"), "directory");
 	openDirectoryAction->setShortcut(QKeySequence(Qt::CTRL + Qt::Key_D));
 	connect(openDirectoryAction, SIGNAL(triggered(bool)), this, SLOT(loadDirectory()));
+	resumeImportsAction = setupKAction("view-refresh", i18n("Resume Imports"), i18n("Resume the imports that were canceled or cut short"), "resume_imports");
+	connect(resumeImportsAction, SIGNAL(triggered(bool)), this, SLOT(resumeImports()));
 	KAction *previousAction = setupKAction("media-skip-backward", i18n("Previous"), previousHelpText, "previous");
 	previousAction->setShortcut(QKeySequence(Qt::Key_Z));
 	connect(previousAction, SIGNAL(triggered(bool)), this, SLOT(previous()));
@@ -223,6 +365,12 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	KAction *queueAction = setupKAction("go-next-view", i18n("Queue Track"), "Enqueue the current track", "queue");
 	queueAction->setShortcut(QKeySequence(Qt::Key_Q));
 	connect(queueAction, SIGNAL(triggered(bool)), this, SLOT(queue()));
+	KAction *queueAlbumAction = setupKAction("go-next-view", i18n("Queue Album"), "Enqueue every track of the selected album", "queue_album");
+	queueAlbumAction->setShortcut(QKeySequence(Qt::SHIFT + Qt::Key_Q));
+	connect(queueAlbumAction, SIGNAL(triggered(bool)), this, SLOT(queueAlbum()));
+	KAction *queueArtistAction = setupKAction("go-next-view", i18n("Queue Artist"), "Enqueue every track of the selected artist", "queue_artist");
+	queueArtistAction->setShortcut(QKeySequence(Qt::ALT + Qt::Key_Q));
+	connect(queueArtistAction, SIGNAL(triggered(bool)), this, SLOT(queueArtist()));
 	shuffleAction = setupKAction("media-playlist-shuffle", i18n("Suffle"), "The next track will be random when checked", "shuffle");
 	shuffleAction->setCheckable(true);
 	connect(shuffleAction, SIGNAL(triggered(bool)), this, SLOT(shuffle(bool)));
@@ -232,13 +380,18 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	connect(viewTrackDetailsAction, SIGNAL(triggered(bool)), this, SLOT(viewTrackDetails()));
 	KAction *viewTrackQueueAction = setupKAction("view-time-schedule-edit", i18n("Track Queue"), i18n("Edit the track queue"), "track_queue");
 	connect(viewTrackQueueAction, SIGNAL(triggered(bool)), this, SLOT(viewTrackQueue()));
+	KAction *viewStatisticsAction = setupKAction("view-statistics", i18n("Statistics"), i18n("View the library's statistics and top tracks"), "statistics");
+	connect(viewStatisticsAction, SIGNAL(triggered(bool)), this, SLOT(viewStatistics()));
+	KAction *viewProfilerAction = setupKAction("utilities-system-monitor", i18n("Profiler"), i18n("View where the player spends its time"), "profiler");
+	connect(viewProfilerAction, SIGNAL(triggered(bool)), profile_window, SLOT(show()));
 	viewPlaylistAction = setupKAction("view-file-columns", i18n("Playlist"), i18n("Show/Hide the playlist"), "playlist");
 	viewPlaylistAction->setCheckable(true);
 	connect(viewPlaylistAction, SIGNAL(triggered(bool)), this, SLOT(viewPlaylist(bool)));
-	connect(artist_list, SIGNAL(currentItemChanged(QListWidgetItem *, QListWidgetItem *)), this, SLOT(updateAlbumList(QListWidgetItem *,  QListWidgetItem *)));
-	connect(album_list,  SIGNAL(currentItemChanged(QListWidgetItem *, QListWidgetItem *)), this, SLOT(updateTitlesList(QListWidgetItem *, QListWidgetItem *)));
-	connect(titles_list, SIGNAL(currentItemChanged(QListWidgetItem *, QListWidgetItem *)), this, SLOT(showTrackInfo(QListWidgetItem *,    QListWidgetItem *)));
-	connect(titles_list, SIGNAL(itemDoubleClicked(QListWidgetItem *)), this, SLOT(play(QListWidgetItem *)));
+	connect(artist_list->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), this, SLOT(updateAlbumList(const QModelIndex &,  const QModelIndex &)));
+	connect(album_list->selectionModel(),  SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), this, SLOT(updateTitlesList(const QModelIndex &, const QModelIndex &)));
+	connect(titles_list->selectionModel(), SIGNAL(currentChanged(const QModelIndex &, const QModelIndex &)), this, SLOT(showTrackInfo(const QModelIndex &,    const QModelIndex &)));
+	connect(titles_list, SIGNAL(doubleClicked(const QModelIndex &)), this, SLOT(play(const QModelIndex &)));
+	connect(titles_model, SIGNAL(rowsFetched()), this, SLOT(titlesFetched()));
 	connect(mw_ok_button,     SIGNAL(clicked()), this, SLOT(hideTrackDetails()));
 	connect(qw_top_button,    SIGNAL(clicked()), this, SLOT(moveQueuedTrackToTop()));
 	connect(qw_up_button,     SIGNAL(clicked()), this, SLOT(moveQueuedTrackUp()));
@@ -246,33 +399,50 @@ Player::Player(QWidget *parent) : KXmlGuiWindow(parent) {
 	connect(qw_bottom_button, SIGNAL(clicked()), this, SLOT(moveQueuedTrackToBottom()));
 	connect(qw_remove_button, SIGNAL(clicked()), this, SLOT(dequeueTrack()));
 	connect(qw_ok_button,     SIGNAL(clicked()), this, SLOT(hideTrackQueue()));
+	connect(library_watch, SIGNAL(dirty(const QString &)),   this, SLOT(libraryPathChanged(const QString &)));
+	connect(library_watch, SIGNAL(created(const QString &)), this, SLOT(libraryPathChanged(const QString &)));
+	connect(library_watch, SIGNAL(deleted(const QString &)), this, SLOT(libraryPathChanged(const QString &)));
+	connect(sync_timer, SIGNAL(timeout()), this, SLOT(syncLibrary()));
+	connect(import_timer, SIGNAL(timeout()), this, SLOT(updateImportProgress()));
+	connect(import_cancel_button, SIGNAL(clicked()), this, SLOT(cancelImports()));
 	
 	//SETUP GUI
 	qsrand(QDateTime::currentDateTime().toTime_t());
 	setupGUI(Default, "projekt7ui.rc");
-	updateArtistList(0);
+	cur_tid = 0;
 	
 	//READ CONFIG
 	config = KGlobal::config();
 	KConfigGroup curTrackDetails(config, "curTrackDetails");
-	cur_artist = artist_list->item(curTrackDetails.readEntry("artist", QString()).toInt());
-	cur_album = curTrackDetails.readEntry("album", QString()).toInt();
-	cur_title = curTrackDetails.readEntry("title", QString()).toInt();
+	cur_tid = curTrackDetails.readEntry("tid", QString()).toInt();
 	KConfigGroup applicationSettings(config, "applicationSettings");
 	viewPlaylistAction->setChecked(applicationSettings.readEntry("playlistVisible", QString()).toInt());
 	shuffle_tracks = applicationSettings.readEntry("shuffleTracks", QString()).toInt();
 	shuffleAction->setChecked(shuffle_tracks);
-	viewCurrentTrack();
-	if (titles_list->count() > 0) {
-		if (titles_list->currentRow() == -1)
-			titles_list->setCurrentRow(0);
-		play(titles_list->currentItem()->data(Qt::UserRole).toInt(), false, false);
-		pause();
-		quint64 song_position = curTrackDetails.readEntry("tick", QString()).toLongLong();
-		now_playing->seek(song_position);
-		tick(song_position);
-		//TODO update the seekSlider's position to match the "tick" location of the song
+	playcount_threshold = applicationSettings.readEntry("playcountThreshold", "50").toInt(); //NOTE: percent of the track that has to be heard
+	playcount_timer->start(applicationSettings.readEntry("playcountFlushInterval", "300").toInt() * 1000);
+	lookahead_depth = qMax(applicationSettings.readEntry("lookaheadTracks", "3").toInt(), 1);
+	history.setDepth(applicationSettings.readEntry("historyDepth", "100").toInt());
+	search_worker = new SearchWorker(db_path, applicationSettings.readEntry("searchLimit", "1000").toInt(), this);
+	connect(search_worker, SIGNAL(resultsReady()), this, SLOT(applySearch()));
+	connect(search_worker, SIGNAL(error(const QString &, const QString &)), this, SLOT(searchFailed(const QString &, const QString &)));
+	covers = new CoverCache(database, &library, KGlobal::dirs()->saveLocation("data") + "projekt7/covers/", applicationSettings.readEntry("coverCacheSize", "16384").toInt(), this); //NOTE: KB of thumbnails held in memory
+	album_model->setCovers(covers);
+	album_list->setIconSize(QSize(CoverCache::Small, CoverCache::Small));
+	connect(covers, SIGNAL(coverRead(int)), this, SLOT(coverRead(int)));
+	connect(covers, SIGNAL(coversLoaded()), this, SLOT(coversLoaded()));
+	covers->start();
+	KConfigGroup librarySettings(config, "library");
+	library_dirs = librarySettings.readEntry("directories", QStringList());
+	QString library_dir;
+	foreach(library_dir, library_dirs)
+		library_watch->addDir(library_dir, KDirWatch::WatchSubDirs);
+	LoadLibraryTask *load = new LoadLibraryTask(database, snapshot_path, LoadLibraryTask::Startup);
+	if (library.readSnapshot(snapshot_path, load->snapshot_generation)) { //NOTE: fills the columns without waiting for the database to open
+		fillArtistList();
+		resumePlayback();
 	}
+	reloadLibrary(load); //NOTE: without a snapshot the window shows empty columns until the library comes back
 }
 
 Player::~Player() {
@@ -286,17 +456,30 @@ void Player::quit() {
 void Player::cleanup() {
 	if (now_playing)
 		now_playing->pause();
+	delete length_scanner; //NOTE: stops the scanner and waits for the file it is reading
+	length_scanner = 0;
+	flushPlaycounts();
+	delete search_worker; //NOTE: interrupts the search in progress and closes its connection
+	search_worker = 0;
+	covers->stop(); //NOTE: the cover being read is finished when the cache is deleted with the window
+	ImportTask *import;
+	foreach(import, running_imports)
+		import->cancel(); //NOTE: each stops at the file it is on and stays in the journal, quitting doesn't wait for a whole import
 	delete queued;
 	delete tray_icon;
 	KConfigGroup curTrackDetails(config, "curTrackDetails");
-	curTrackDetails.writeEntry("artist", QString::number(artist_list->row(cur_artist)));
-	curTrackDetails.writeEntry("album",  QString::number(cur_album));
-	curTrackDetails.writeEntry("title",  QString::number(cur_title));
+	curTrackDetails.writeEntry("tid",    QString::number(cur_tid));
 	curTrackDetails.writeEntry("tick",   QString::number(now_playing->currentTime()));
 	KConfigGroup applicationSettings(config, "applicationSettings");
 	applicationSettings.writeEntry("playlistVisible", QString::number(viewPlaylistAction->isChecked()));
 	applicationSettings.writeEntry("shuffleTracks",   QString::number(shuffleAction->isChecked()));
-	sqlite3_close(tracks_db);
+	artist_model->close();
+	album_model->close();
+	titles_model->close();
+	import_database->stop();
+	database->stop();
+	import_database->wait(); //NOTE: the canceled imports stop at the file they are on
+	database->wait(); //NOTE: the one wait on the database, so the play counts and shuffle draws posted above are written
 }
 
 KAction* Player::setupKAction(const char *icon, QString text, QString help_text, const char *name) {
@@ -308,149 +491,232 @@ KAction* Player::setupKAction(const char *icon, QString text, QString help_text,
 	return action;
 }
 
+QListView* Player::setupListView(BrowseModel *model, QWidget *parent) {
+	QListView *view = new QListView(parent);
+	view->setUniformItemSizes(true); //NOTE: lets the view lay out a lazily fetched column without asking for every row
+	view->setModel(model);
+	return view;
+}
+
 void Player::loadFiles() {
-	loadFiles(KFileDialog::getOpenFileNames(KUrl(), "audio/mpeg audio/mp4 audio/ogg audio/aac audio/flac")); //TODO replace the explicit type list with a generic audio list (does not see *.mp4 audio files)
+	QStringList files = KFileDialog::getOpenFileNames(KUrl(), "audio/mpeg audio/mp4 audio/ogg audio/aac audio/flac"); //TODO replace the explicit type list with a generic audio list (does not see *.mp4 audio files)
+	if (files.count() == 0)
+		return;
+	ImportTask *task = new ImportTask;
+	task->files = files;
+	task->stamp_dir = QFileInfo(files.first()).absolutePath();
+	startImport(task, true);
 }
 
 void Player::loadDirectory() {
-	QStringList files;
-	QString path = KFileDialog::getExistingDirectory(); //TODO filter for only audio files
+	QString path = KFileDialog::getExistingDirectory();
 	if (path == "")
 		return;
-	readDirectory(path, files);
-	loadFiles(files);
+	path = QDir::cleanPath(path);
+	ImportTask *task = new ImportTask;
+	task->scan_dir = path; //NOTE: walked on the import worker's side, the window isn't held up by it
+	task->stamp_dir = path;
+	startImport(task, true);
+	if (!library_dirs.contains(path)) {
+		library_dirs.push_back(path);
+		KConfigGroup librarySettings(config, "library");
+		librarySettings.writeEntry("directories", library_dirs);
+		config->sync();
+		library_watch->addDir(path, KDirWatch::WatchSubDirs);
+	}
 }
 
-void Player::readDirectory(const QDir &dir, QStringList &files) {
-	QFileInfoList children = dir.entryInfoList();
-	QFileInfoList::iterator itt, end = children.end();
-	for (itt = children.begin(); itt != end; ++itt) {
-		QString name = itt->fileName();
-		if (name != "." && name != "..") {
-			if (itt->isDir())
-				readDirectory(QDir(itt->absoluteFilePath()), files);
-			else
-				files.push_back(itt->absoluteFilePath());
-		}
+void Player::libraryPathChanged(const QString &path) {
+	QFileInfo info(path);
+	dirty_dirs.insert(QDir::cleanPath(info.isDir() ? info.absoluteFilePath() : info.absolutePath()));
+	if (!sync_timer->isActive())
+		sync_timer->start(); //NOTE: not restarted by later events, a steady stream of changes still gets flushed every window
+}
+
+void Player::syncLibrary() {
+	if (importing > 0) { //NOTE: changes made by the running import are picked up by its own reload, don't queue a rescan behind it
+		sync_timer->start();
+		return;
 	}
+	ImportTask *task = new ImportTask;
+	task->sync_dirs = dirty_dirs.toList();
+	task->view_current_track = false;
+	dirty_dirs.clear();
+	startImport(task, false);
 }
 
-void Player::loadFiles(const QStringList &files) {
-	if (files.count() == 0)
+void Player::startImport(ImportTask *task, bool show_progress) {
+	KConfigGroup applicationSettings(config, "applicationSettings");
+	task->batch_size = applicationSettings.readEntry("importBatchSize", "500").toInt();
+	++importing;
+	resumeImportsAction->setEnabled(false); //NOTE: the imports that are running are in the journal as well
+	pauseLengthScanner();
+	if (show_progress) {
+		if (running_imports.isEmpty())
+			import_progress->setRange(0, 0); //NOTE: the files are counted as they are found
+		running_imports.push_back(task);
+		import_progress->show();
+		import_cancel_button->show();
+		import_timer->start();
+	}
+	import_database->post(task, this, "importFinished");
+}
+
+void Player::updateImportProgress() {
+	if (running_imports.isEmpty())
 		return;
-	QProgressDialog progress("    Don't worry. I'm wondering why it takes so long to read tag information too ...    ", "Cancel", 2, files.count(), this);
-	progress.setWindowModality(Qt::WindowModal);
-	uint i = 0;
-	QStringList::const_iterator itt, end = files.constEnd();
-	for (itt = files.constBegin(); itt != end; ++itt) {
-		progress.setValue(++i);
-		TagLib::FileRef f(itt->toUtf8().constData()); //NOTE: don't ask me why TabLib won't accept qtos(*itt), but this seems to work for international characters
-		char *query = sqlite3_mprintf("INSERT INTO `tracks` (`artist`, `year`, `album`, `track_number`, `title`, `path`) VALUES (%Q, %u, %Q, %u, %Q, %Q)", f.tag()->artist().toCString(), f.tag()->year(), f.tag()->album().toCString(), f.tag()->track(), f.tag()->title().toCString(), qtos(*itt));
-		char *errmsg;
-		int return_code = sqlite3_exec(tracks_db, query, 0, 0, &errmsg);
-		if (return_code) {
-			showError("Failed to insert tracks: ", errmsg);
-			sqlite3_free(errmsg);
-			exit(return_code);
-		}
-		sqlite3_free(query);
-		if (progress.wasCanceled())
-			break;
+	ImportTask *import = running_imports.first(); //NOTE: the one the import worker is running, the others wait behind it
+	int done = import->progress(); //NOTE: before found(), every file done has been found by then
+	import_progress->setMaximum(import->found());
+	import_progress->setValue(done);
+}
+
+void Player::cancelImports() {
+	ImportTask *import;
+	foreach(import, running_imports)
+		import->cancel();
+	statusBar()->showMessage(i18n("Import canceled, it is resumed at the next start or with File > Resume Imports"), 10000);
+}
+
+void Player::resumeImports() {
+	resumeImportsAction->setEnabled(false);
+	import_database->post(new ReadJournalTask, this, "importsRead"); //NOTE: an import started after this is posted is journaled after it has run, on the same worker
+}
+
+void Player::importsRead(DatabaseTask *task) {
+	ReadJournalTask *journal = static_cast<ReadJournalTask *>(task);
+	ImportTask *import;
+	foreach(import, journal->imports)
+		startImport(import, true);
+	journal->imports.clear();
+	resumeImportsAction->setEnabled(importing == 0);
+}
+
+void Player::importFinished(DatabaseTask *task) {
+	ImportTask *import = static_cast<ImportTask *>(task);
+	if (running_imports.removeOne(import) && running_imports.isEmpty()) {
+		import_timer->stop();
+		import_progress->hide();
+		import_cancel_button->hide();
 	}
-	updateNumTracks();
-	updateArtistList(cur_artist);
+	statusBar()->showMessage(i18n("%1 new, %2 changed, %3 unchanged, %4 removed tracks", import->inserted, import->updated, import->unchanged, import->removed), 10000);
+	--importing;
+	resumeImportsAction->setEnabled(importing == 0);
+	pauseLengthScanner();
+	if (import->view_current_track)
+		reloadLibrary(new LoadLibraryTask(database, snapshot_path, LoadLibraryTask::CurrentTrack));
+	else {
+		LoadLibraryTask *load = new LoadLibraryTask(database, snapshot_path, LoadLibraryTask::Artist); //NOTE: reselecting the artist reloads its albums and titles
+		load->aid = artist_model->id(artist_list->currentIndex().row());
+		reloadLibrary(load);
+	}
+}
+
+void Player::startLengthScanner() {
+	database->post(new MissingLengthsTask, this, "missingLengthsRead");
+}
+
+void Player::missingLengthsRead(DatabaseTask *task) {
+	MissingLengthsTask *missing = static_cast<MissingLengthsTask *>(task);
+	if (missing->tids.isEmpty() || length_scanner)
+		return;
+	KConfigGroup applicationSettings(config, "applicationSettings");
+	length_scanner = new LengthScanner(missing->tids, missing->paths, applicationSettings.readEntry("lengthBatchSize", "100").toInt());
+	connect(length_scanner, SIGNAL(lengthsRead()), this, SLOT(writeLengths()));
+	pauseLengthScanner();
+	length_scanner->start(QThread::IdlePriority);
+}
+
+void Player::pauseLengthScanner() {
+	if (!length_scanner)
+		return;
+	Phonon::State state = now_playing->state();
+	length_scanner->setPaused(importing > 0 || state == Phonon::LoadingState || state == Phonon::BufferingState); //NOTE: a seek buffers, let it have the disk
+}
+
+void Player::writeLengths() {
+	if (!length_scanner)
+		return;
+	QList<TrackLength> lengths = length_scanner->take();
+	if (!lengths.isEmpty())
+		database->post(new LengthsTask(lengths));
+}
+
+void Player::playbackStateChanged(Phonon::State) {
+	pauseLengthScanner();
 }
 
 void Player::enqueueNext() {
+	countPlay(); //NOTE: the track made it to the end, whatever the threshold
 	next(false);
 }
 
 void Player::previous() {
-	bool skipped_to_get_here = false;
 	if (history.count() > 1) {
-		bool track_exists = false;
-		bool first_attempt = true;
-		do {
-			if (first_attempt) {
-				history.pop_back();
-				first_attempt = false;
-			}
-			HistoryItem prev = history.takeLast();
-			char *query = sqlite3_mprintf("SELECT `tid` FROM `tracks` WHERE `tid`=%u", prev.tid);
-			sqlite3_stmt *trackQuery = 0;
-			prepare(query, &trackQuery, "Failed to Prepare `tid` query: ");
-			bool done = false;
-			do {
-				if (step(trackQuery, done, true, "Failed to Step `tid` in previous: "))
-					track_exists = true;
-				else
-					skipped_to_get_here = true;
-			} while (!done);
-			if (track_exists) {
-				cur_artist = prev.artist;
-				cur_album = prev.album;
-				cur_title = prev.title;
-				viewCurrentTrack();
-				play(prev.tid);
-			}
-		} while (!track_exists && history.count() > 0);
-	}
-	if (history.count() <= 1 && !skipped_to_get_here) {
-		if (history.count() == 1)
-			history.pop_back();
-		now_playing->stop();
-		setWindowTitle("Projekt 7");
+		history.pop(); //NOTE: the track that is playing now
+		int tid = history.pop(); //NOTE: deleted tracks were dropped when the library was reloaded, nothing to skip
+		cur_tid = tid;
+		viewCurrentTrack();
+		play(tid);
+		return;
 	}
+	if (history.count() == 1)
+		history.pop();
+	now_playing->stop();
+	setWindowTitle("Projekt 7");
 }
 
 void Player::play() {
 	if (now_playing->state() == Phonon::PausedState)
 		now_playing->play();
-	else if (titles_list->currentItem())
-		play(titles_list->currentItem()->data(Qt::UserRole).toInt());
+	else if (titles_list->currentIndex().isValid())
+		play(titles_model->id(titles_list->currentIndex().row()));
 }
 
-void Player::play(QListWidgetItem *titles_list_item) {
-	if (titles_list_item != 0)
-		play(titles_list_item->data(Qt::UserRole).toInt());
+void Player::play(const QModelIndex &titles_list_index) {
+	if (titles_list_index.isValid())
+		play(titles_model->id(titles_list_index.row()));
 }
 
 void Player::play(int tid, bool play, bool add_to_history) {
-	cur_artist = artist_list->currentItem();
-	cur_album = album_list->currentRow() > 0 ? album_list->currentRow() : 0;
-	cur_title = titles_list->currentRow() > 0 ? titles_list->currentRow() : 0;
-	if (add_to_history) {
-		history.push_back(HistoryItem(cur_artist, cur_album, cur_title, tid));
-		if (history.count() > 100)
-			history.pop_front();
+	UpcomingTrack track;
+	if (!resolveTrack(tid, track))
+		return;
+	invalidateLookahead(); //NOTE: the tracks that follow depend on this one
+	playTrack(track, play, add_to_history);
+}
+
+void Player::playTrack(const UpcomingTrack &track, bool play, bool add_to_history) {
+	cur_tid = track.tid;
+	if (add_to_history)
+		history.push(track.tid);
+	if (play) {
+		playing_tid = track.tid;
+		next_track.tid = 0;
+		play_counted = false;
+		now_playing->setCurrentSource(track.path);
+		now_playing->play();
+		tick(0);
+		showTrack(track, add_to_history);
+	} else {
+		next_track = track; //NOTE: shown and counted once Phonon actually moves on to it, see sourceChanged()
+		now_playing->enqueue(track.path);
 	}
-	sqlite3_stmt *trackQuery = 0;
-	char *query = sqlite3_mprintf("SELECT `artist`, `year`, `album`, `track_number`, `title`, `path` FROM `tracks` WHERE `tid`=%u LIMIT 1", tid);
-	prepare(query, &trackQuery, "Failed to Prepare `path` query: ");
-	bool done = false;
-	do {
-		if (step(trackQuery, done, true, "Failed to Step `path` in play: ")) {
-			char *path = sqlite3_mprintf("%s", sqlite3_column_text(trackQuery, 5)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-			QString qpath(path);
-			sqlite3_free(path);
-			if (play) {
-				now_playing->setCurrentSource(qpath);
-				now_playing->play();
-				tick(0);
-			}
-			else
-				now_playing->enqueue(qpath);
-			setQLabelText("%s", trackQuery, 0, mw_artist);
-			setQLabelText("%s", trackQuery, 1, mw_year);
-			setQLabelText("%s", trackQuery, 2, mw_album);
-			setQLabelText("%s", trackQuery, 3, mw_track_number);
-			setQLabelText("%s", trackQuery, 4, mw_title);
-			mw_path->setText(qpath);
-			setWindowTitle(mw_artist->text() + " - " + mw_title->text() + "  |  Projekt 7");
-			if (add_to_history)
-				tray_icon->showMessage("Projekt 7 | Now Playing:", mw_artist->text() + " - " + mw_title->text(), QSystemTrayIcon::NoIcon, 5000);
-		}
-	} while (!done);
+}
+
+void Player::showTrack(const UpcomingTrack &track, bool notify) {
+	mw_artist->setText(track.artist);
+	mw_year->setText(track.year);
+	mw_album->setText(track.album);
+	mw_track_number->setText(track.track_number);
+	mw_title->setText(track.title);
+	mw_path->setText(track.path);
+	int position = library.position(track.tid);
+	mw_alid = position != -1 ? library.albumId(library.albumOf(position)) : 0;
+	showCover();
+	setWindowTitle(track.artist + " - " + track.title + "  |  Projekt 7");
+	if (notify)
+		tray_icon->showMessage("Projekt 7 | Now Playing:", track.artist + " - " + track.title, QSystemTrayIcon::NoIcon, 5000);
 }
 
 void Player::pause() {
@@ -462,57 +728,129 @@ void Player::next() {
 }
 
 void Player::next(bool play_track) {
-	if (titles_list->count() == 0)
+	if (library.count() == 0)
 		return;
-	if (track_queue.count()) {
-		int tid = track_queue.takeFirst();
-		selectTrack(tid);
-		track_queue_info.remove(tid);
-		titles_list->currentItem()->setIcon(dequeud);
-	} else {
-		if (shuffle_tracks) {
-			char *query = sqlite3_mprintf("SELECT `tid` FROM `tracks` LIMIT 1 OFFSET %i", (qrand() % num_tracks) + 1); //NOTE: the lowest `tid` is '1'
-			sqlite3_stmt *shuffleQuery = 0;
-			prepare(query, &shuffleQuery, "Failed to Prepare shuffle query: ");
-			bool done = false;
-			int tid = 0;
-			if (step(shuffleQuery, done, true, "Failed to Step shuffle in next(): "))
-				tid = sqlite3_column_int(shuffleQuery, 0);
-			selectTrack(tid);
+	if (upcoming.isEmpty())
+		resolveUpcoming(1); //NOTE: the lookahead hasn't caught up (or the shuffle bag is at the end of a pass)
+	if (upcoming.isEmpty())
+		return;
+	UpcomingTrack track = upcoming.takeFirst();
+	switch (track.source) {
+		case UpcomingTrack::Queued:
+			track_queue.remove(track.tid);
+			break;
+		case UpcomingTrack::Shuffled:
+			shuffle_bag.next(); //NOTE: draws the track the lookahead peeked at
+			break;
+		case UpcomingTrack::Sequential:
+			break;
+	}
+	cur_tid = track.tid;
+	if (play_track) {
+		selectTrack(cur_tid); //NOTE: set before selecting, so the columns open on the track's album instead of [All]
+		titles_model->updateId(cur_tid);
+	}
+	playTrack(track, play_track);
+	lookahead_timer->start();
+}
+
+void Player::resolveUpcoming(int depth) {
+	int queued = 0, shuffled = 0, last_tid = cur_tid;
+	UpcomingTrack track;
+	foreach(track, upcoming) {
+		if (track.source == UpcomingTrack::Queued)
+			++queued;
+		else if (track.source == UpcomingTrack::Shuffled)
+			++shuffled;
+		last_tid = track.tid;
+	}
+	while (upcoming.count() < depth && library.count() > 0) {
+		int tid = 0;
+		if (queued < track_queue.count()) {
+			tid = track_queue.at(queued++);
+			track.source = UpcomingTrack::Queued;
+		} else if (shuffle_tracks) {
+			tid = shuffle_bag.peek(shuffled++);
+			if (tid == 0) //NOTE: the rest of the lookahead is in the next pass, which isn't shuffled until this one is drawn
+				return;
+			track.source = UpcomingTrack::Shuffled;
 		} else {
-			artist_list->setCurrentItem(cur_artist);
-			if (++cur_title >= titles_list->count()) {
-				cur_title = 0;
-				if (cur_album == 0 || ++cur_album >= album_list->count()) {
-					cur_album = 1;
-					int next_artist = artist_list->row(cur_artist) + 1;
-					cur_artist = artist_list->item(next_artist >= artist_list->count() ? 1 : next_artist);
-					artist_list->setCurrentItem(cur_artist);
-				}
-				else
-					album_list->setCurrentItem(album_list->item(cur_album));
-			}
-			titles_list->setCurrentItem(titles_list->item(cur_title));
+			tid = library.following(last_tid); //NOTE: a deleted current track starts over from the first track
+			track.source = UpcomingTrack::Sequential;
 		}
+		if (!resolveTrack(tid, track))
+			return;
+		upcoming.push_back(track);
+		last_tid = tid;
 	}
-	play(titles_list->currentItem()->data(Qt::UserRole).toInt(), play_track);
+}
+
+bool Player::resolveTrack(int tid, UpcomingTrack &track) {
+	int position = library.position(tid);
+	if (position == -1)
+		return false;
+	track.tid = tid;
+	track.artist = library.artistName(library.artistOf(position));
+	track.year = QString::number(library.year(position));
+	track.album = library.albumName(library.albumOf(position));
+	track.track_number = QString::number(library.trackNumber(position));
+	track.title = library.title(position);
+	track.path = library.path(position);
+	return true;
+}
+
+void Player::fillLookahead() {
+	resolveUpcoming(lookahead_depth);
+}
+
+void Player::invalidateLookahead() {
+	upcoming.clear();
+	lookahead_timer->start();
 }
 
 void Player::queue() {
-	int tid = titles_list->currentItem()->data(Qt::UserRole).toInt();
-	if (track_queue.contains(tid)) {
-		track_queue.removeAll(tid);
-		track_queue_info.remove(tid);
-		titles_list->currentItem()->setIcon(dequeud);
-	} else {
-		track_queue.push_back(tid);
-		track_queue_info.insert(tid, artist_list->currentItem()->text() + " - " + titles_list->currentItem()->text());
-		titles_list->currentItem()->setIcon(*queued);
+	int tid = titles_model->id(titles_list->currentIndex().row());
+	int position = library.position(tid);
+	if (position == -1)
+		return;
+	if (track_queue.contains(tid))
+		track_queue.remove(tid);
+	else
+		track_queue.append(QList<int>() << tid);
+	titles_model->updateId(tid);
+	invalidateLookahead();
+}
+
+void Player::queueAlbum() {
+	int album = library.albumIndex(album_model->id(album_list->currentIndex().row()));
+	if (album < 0) //NOTE: [All] and the albums listed by name under [All] aren't a range of the library
+		return;
+	queueTracks(library.firstTrack(album), library.firstTrack(album + 1));
+}
+
+void Player::queueArtist() {
+	int artist = library.artistIndex(artist_model->id(artist_list->currentIndex().row()));
+	if (artist < 0)
+		return;
+	queueTracks(library.firstTrack(library.firstAlbum(artist)), library.firstTrack(library.firstAlbum(artist + 1)));
+}
+
+void Player::queueTracks(int first, int end) {
+	QList<int> tids;
+	for (int position = first; position < end; ++position) {
+		int tid = library.tid(position);
+		if (!searching || search_tids.contains(tid)) //NOTE: while searching, only the matches that are listed
+			tids.push_back(tid);
 	}
+	if (track_queue.append(tids) == 0)
+		return;
+	titles_model->updateDecorations();
+	invalidateLookahead();
 }
 
 void Player::shuffle(bool checked) {
 	shuffle_tracks = checked;
+	invalidateLookahead();
 }
 
 void Player::updateDuration(qint64 duration) {
@@ -520,6 +858,7 @@ void Player::updateDuration(qint64 duration) {
 	QTextStream qout(&time);
 	qout << formatTime(duration);
 	track_duration->setText(time);
+	cur_duration = duration;
 }
 
 void Player::tick(qint64 tick) {
@@ -527,16 +866,41 @@ void Player::tick(qint64 tick) {
 	QTextStream qout(&time);
 	qout << ' ' << formatTime(tick);
 	cur_time->setText(time);
+	if (!play_counted && cur_duration > 0 && tick * 100 >= cur_duration * playcount_threshold)
+		countPlay();
+}
+
+void Player::sourceChanged() {
+	if (next_track.tid == 0)
+		return;
+	playing_tid = next_track.tid;
+	play_counted = false;
+	showTrack(next_track, true);
+	titles_model->updateId(playing_tid); //NOTE: clears the queued icon, if it was queued
+	if (playing_tid == cur_tid)
+		selectTrack(cur_tid);
+	next_track.tid = 0;
+}
+
+void Player::countPlay() {
+	if (play_counted || playing_tid == 0)
+		return;
+	play_counted = true;
+	++pending_plays[playing_tid];
+}
+
+void Player::flushPlaycounts() {
+	if (pending_plays.isEmpty())
+		return;
+	database->post(new PlaycountsTask(pending_plays));
+	pending_plays.clear();
 }
 
 void Player::viewCurrentTrack() {
-	if (cur_artist)
-		artist_list->setCurrentItem(cur_artist);
+	if (library.contains(cur_tid))
+		selectTrack(cur_tid);
 	else
-		artist_list->setCurrentRow(0);
-	if (album_list->currentRow() != cur_album)
-		album_list->setCurrentItem(album_list->item(cur_album));
-	titles_list->setCurrentRow(cur_title);
+		artist_list->setCurrentIndex(artist_model->index(0));
 }
 
 void Player::viewTrackDetails() {
@@ -549,17 +913,25 @@ void Player::hideTrackDetails() {
 
 void Player::viewTrackQueue() {
 	int tid;
-	foreach(tid, track_queue)
-		qw_queue_list->addItem(new QListWidgetItem(track_queue_info[tid]));
+	foreach(tid, track_queue.tids()) {
+		int position = library.position(tid);
+		qw_queue_list->addItem(new QListWidgetItem(library.artistName(library.artistOf(position)) + " - " + library.title(position)));
+	}
 	queue_window->setVisible(true);
 }
 
 void Player::hideTrackQueue() {
 	qw_queue_list->clear();
-	updateTitlesList(album_list->currentItem());
+	titles_model->updateDecorations();
 	queue_window->setVisible(false);
 }
 
+void Player::viewStatistics() {
+	flushPlaycounts(); //NOTE: posted ahead of the statistics queries, so they see these plays
+	stats_window->refresh();
+	stats_window->setVisible(true);
+}
+
 void Player::viewPlaylist(bool show) {
 	if (show) {
 		playlist_widget->setVisible(true);
@@ -573,189 +945,368 @@ void Player::viewPlaylist(bool show) {
 
 void Player::moveQueuedTrackToTop() {
 	int row = qw_queue_list->currentRow();
-	if (row == 0)
+	if (row <= 0)
 		return;
-	track_queue.push_front(track_queue.takeAt(row));
+	track_queue.move(row, 0);
 	qw_queue_list->insertItem(0, qw_queue_list->takeItem(row));
 	qw_queue_list->setCurrentRow(0);
+	invalidateLookahead();
 }
 
 void Player::moveQueuedTrackUp() {
 	int row = qw_queue_list->currentRow();
-	if (row == 0)
+	if (row <= 0)
 		return;
-	track_queue.swap(row - 1, row);
+	track_queue.move(row, row - 1);
 	qw_queue_list->insertItem(row - 1, qw_queue_list->takeItem(row));
 	qw_queue_list->setCurrentRow(row - 1);
+	invalidateLookahead();
 }
 
 void Player::moveQueuedTrackDown() {
 	int row = qw_queue_list->currentRow();
-	if (row == qw_queue_list->count() - 1)
+	if (row < 0 || row == qw_queue_list->count() - 1)
 		return;
+	track_queue.move(row, row + 1);
 	qw_queue_list->insertItem(row + 1, qw_queue_list->takeItem(row));
 	qw_queue_list->setCurrentRow(row + 1);
+	invalidateLookahead();
 }
 
 void Player::moveQueuedTrackToBottom() {
 	int row = qw_queue_list->currentRow();
-	if (row == qw_queue_list->count() - 1)
+	if (row < 0 || row == qw_queue_list->count() - 1)
 		return;
+	track_queue.move(row, track_queue.count() - 1);
 	qw_queue_list->addItem(qw_queue_list->takeItem(row));
 	qw_queue_list->setCurrentRow(qw_queue_list->count() - 1);
+	invalidateLookahead();
 }
 
 void Player::dequeueTrack() {
 	int row = qw_queue_list->currentRow();
-	track_queue.removeAt(row);
-	track_queue_info.remove(qw_queue_list->currentItem()->data(Qt::UserRole).toInt());
+	if (row < 0)
+		return;
+	int tid = track_queue.at(row);
+	track_queue.remove(tid);
 	delete qw_queue_list->takeItem(row);
+	titles_model->updateId(tid);
+	invalidateLookahead();
 }
 
-void Player::updateArtistList(QListWidgetItem *artist_list_item) {
-	static sqlite3_stmt *artistQuery = 0;
-	if (artistQuery == 0) {
-		char *query = sqlite3_mprintf("%s", "SELECT `artist` FROM `tracks` GROUP BY `artist` COLLATE NOCASE");
-		prepare(query, &artistQuery, "Failed to Prepare `artist` GUI update query: ");
+void Player::reloadLibrary(LoadLibraryTask *task) {
+	task->previous = library; //NOTE: implicitly shared, the task only reads it
+	database->post(task, this, "libraryLoaded");
+}
+
+void Player::libraryLoaded(DatabaseTask *task) {
+	LoadLibraryTask *load = static_cast<LoadLibraryTask *>(task);
+	shuffle_bag.restore(load->shuffle_bag, load->library);
+	covers->load(); //NOTE: an import takes the albums it wrote tracks of out of `album_covers`
+	if (load->reselect == LoadLibraryTask::Startup) {
+		track_queue.restore(load->track_queue);
+		history.restore(load->history);
+		titles_model->updateDecorations();
+		search_worker->start(); //NOTE: its read-only connection needs the schema the DatabaseWorker has just brought up to date
+		import_database->start(); //NOTE: the same, imports posted before now wait for it
+		startLengthScanner();
+		resumeImports();
+		if (load->snapshot_current) { //NOTE: the columns filled from the snapshot are what the database holds
+			invalidateLookahead();
+			return;
+		}
 	}
-	bool done = false;
-	bool artists_present = artist_list->count() > 1;
-	int i = 0;
-	do {
-		if (step(artistQuery, done, false, "Failed to Step `artist` in GUI update: ")) {
-			char *artist = sqlite3_mprintf("%s", sqlite3_column_text(artistQuery, 0)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-			if (artists_present && i < artist_list->count() - 1) {
-				QString qartist(artist);
-				//NOTE: if the location in the list of artists is not equal to the value from the database, then
-				//this artist was added during the most recent call to `loadFiles` or `readDirectory` and needs to be added to the list
-				if (artist_list->item(++i)->text() != qartist) {
-					artist_list->insertItem(i, qartist);
-				}
-			}
+	library = load->library;
+	if (searching) {
+		indexSearchMatches(); //NOTE: the artist and album indexes of the matches have moved
+		search_worker->search(search_edit->text().trimmed()); //NOTE: picks up matching tracks that have just been imported
+	}
+	fillArtistList();
+	track_queue.retain(library); //NOTE: deleted tracks leave the queue, so everything the lookahead resolves from it exists
+	history.retain(library);
+	invalidateLookahead();
+	switch (load->reselect) {
+		case LoadLibraryTask::Startup:
+			if (load->snapshot_generation == -1)
+				resumePlayback();
 			else
-				artist_list->addItem(artist);
-			sqlite3_free(artist);
+				viewCurrentTrack(); //NOTE: the snapshot was stale, playback has already been resumed from it
+			break;
+		case LoadLibraryTask::CurrentTrack:
+			viewCurrentTrack();
+			break;
+		case LoadLibraryTask::Artist:
+			selectArtist(load->aid);
+			break;
+		case LoadLibraryTask::Rows:
+			reselectRows(load);
+			break;
+	}
+}
+
+void Player::resumePlayback() {
+	if (!library.contains(cur_tid))
+		cur_tid = library.count() > 0 ? library.tid(0) : 0;
+	viewCurrentTrack();
+	UpcomingTrack track;
+	if (resolveTrack(cur_tid, track)) {
+		playing_tid = cur_tid;
+		play_counted = false;
+		now_playing->setCurrentSource(track.path); //NOTE: what enqueue does when nothing is loaded, but without waiting for a source change to show it
+		showTrack(track, false);
+		pause();
+		KConfigGroup curTrackDetails(config, "curTrackDetails");
+		quint64 song_position = curTrackDetails.readEntry("tick", QString()).toLongLong();
+		now_playing->seek(song_position);
+		tick(song_position);
+		//TODO update the seekSlider's position to match the "tick" location of the song
+	}
+}
+
+void Player::reselectRows(const LoadLibraryTask *load) {
+	if (!library.contains(cur_tid)) //NOTE: the track that followed the deleted current track takes its place
+		cur_tid = library.count() > 0 ? library.tid(qMin(qMax(load->position, 0), library.count() - 1)) : 0;
+	switch (load->delete_level) {
+		case AllTracksLevel:
+			statusBar()->changeItem("", SONG_NAME);
+			artist_list->setCurrentIndex(artist_model->index(0));
+			break;
+		case ArtistLevel:
+			artist_list->setCurrentIndex(artist_model->index(qMin(load->artist_row, artist_model->rowCount() - 1)));
+			break;
+		case AlbumLevel:
+			artist_list->setCurrentIndex(artist_model->index(load->artist_row));
+			album_list->setCurrentIndex(album_model->index(qMin(load->album_row, album_model->rowCount() - 1)));
+			break;
+		case TrackLevel:
+			artist_list->setCurrentIndex(artist_model->index(qMin(load->artist_row, artist_model->rowCount() - 1)));
+			album_list->setCurrentIndex(album_model->index(qMin(load->album_row, album_model->rowCount() - 1)));
+			pending_title_row = load->title_row; //NOTE: the row may still be on its way from the database
+			titlesFetched();
+			break;
+	}
+}
+
+void Player::fillArtistList() {
+	ProfileSpan span("Fill artist list");
+	QVector<int> ids;
+	QStringList names;
+	if (searching) {
+		QList<int> artists = search_artists.toList();
+		qSort(artists);
+		int artist;
+		foreach(artist, artists) {
+			ids.push_back(library.artistId(artist));
+			names.push_back(library.artistName(artist));
 		}
-	} while (!done);
-	if (artist_list_item == 0) {
-		if (artist_list->count() > 0)
-			artist_list->setCurrentItem(0);
 	}
 	else
-		artist_list->setCurrentItem(artist_list_item);
+		library.artists(ids, names);
+	artist_model->mergeRows(ids, names);
+	refillAlbumList();
+}
+
+//NOTE: the albums and titles of the selected artist may have changed without the selection changing, keeps the album selected
+void Player::refillAlbumList() {
+	int alid = album_model->id(album_list->currentIndex().row());
+	updateAlbumList(artist_list->currentIndex(), QModelIndex());
+	int row = alid ? album_model->row(alid) : -1; //NOTE: the albums listed by name under [All] all have `id` 0
+	if (row != -1)
+		album_list->setCurrentIndex(album_model->index(row));
 }
 
-void Player::updateAlbumList(QListWidgetItem *artist_list_item, QListWidgetItem *prev_artist) {
-	if (artist_list_item == prev_artist)
+void Player::startSearch() {
+	QString text = search_edit->text().trimmed();
+	if (!text.isEmpty()) {
+		search_worker->search(text);
+		return;
+	}
+	if (!searching)
 		return;
-	sqlite3_stmt *albumQuery;
-	char *query;
-	if (artist_list_item == 0 || artist_list->currentRow() == 0)
-		query = sqlite3_mprintf("%s", "SELECT `artist`, `album` FROM `tracks` GROUP BY `album` ORDER BY `album` COLLATE NOCASE");
+	searching = false;
+	search_text.clear();
+	search_tids.clear();
+	search_artists.clear();
+	search_albums.clear();
+	fillArtistList();
+	viewCurrentTrack();
+}
+
+void Player::searchFailed(const QString &part1, const QString &part2) {
+	statusBar()->showMessage(part1 + part2, 10000); //NOTE: not a dialog, the search box is being typed in and the player keeps playing
+	search_edit->clear(); //NOTE: startSearch() takes the filter off
+}
+
+void Player::applySearch() {
+	QString text;
+	QList<int> tids;
+	if (!search_worker->take(text, tids) || text != search_edit->text().trimmed()) //NOTE: the text has changed since, its own search is on the way
+		return;
+	bool refined = searching && text == search_text; //NOTE: every match after the first page, or the same search after a reload, the selection stays
+	searching = true;
+	search_text = text;
+	search_tids = tids.toSet();
+	indexSearchMatches();
+	fillArtistList(); //NOTE: keeps the selected artist and album, their new matches are filled in
+	if (refined)
+		return;
+	if (search_tids.contains(cur_tid))
+		selectTrack(cur_tid);
 	else
-		query = sqlite3_mprintf("SELECT `artist`, `album` FROM `tracks` WHERE `artist`=%Q GROUP BY `album` ORDER BY `year`, `album` COLLATE NOCASE", qtos(artist_list_item->text()));
-	prepare(query, &albumQuery, "Failed to Prepare `album` GUI update query: ");
-	bool done = false;
-	album_list->clear();
-	album_list->addItem(ALL);
-	do {
-		if (step(albumQuery, done, true, "Failed to Step `album` in GUI update: ")) {
-			char *artist = sqlite3_mprintf("%s", sqlite3_column_text(albumQuery, 0)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-			char *album = sqlite3_mprintf("%s", sqlite3_column_text(albumQuery, 1)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-			QListWidgetItem *new_item = new QListWidgetItem(album);
-			new_item->setData(Qt::UserRole, artist);
-			album_list->addItem(new_item);
-			sqlite3_free(artist);
-			sqlite3_free(album);
+		artist_list->setCurrentIndex(artist_model->index(0));
+}
+
+void Player::indexSearchMatches() {
+	search_artists.clear();
+	search_albums.clear();
+	int tid;
+	foreach(tid, search_tids) {
+		int position = library.position(tid);
+		if (position != -1) {
+			search_artists.insert(library.artistOf(position));
+			search_albums.insert(library.albumOf(position));
 		}
-	} while (!done);
-	if (artist_list->currentItem() != artist_list_item)
-		artist_list->setCurrentRow(artist_list->row(artist_list_item));
-	if (album_list->count() > 0) {
-		if (artist_list_item == cur_artist)
-			album_list->setCurrentItem(album_list->item(cur_album));
-		else
-			album_list->setCurrentItem(album_list->item(0));
 	}
 }
 
-void Player::updateTitlesList(QListWidgetItem *album_list_item, QListWidgetItem *prev_album) {
-	if (album_list_item == prev_album)
+void Player::selectArtist(int aid) {
+	int row = artist_model->row(aid);
+	artist_list->setCurrentIndex(artist_model->index(row == -1 ? 0 : row)); //NOTE: row 0 is [All], as is an unknown `aid`
+}
+
+void Player::updateAlbumList(const QModelIndex &artist_list_index, const QModelIndex &prev_artist) {
+	if (artist_list_index == prev_artist)
 		return;
-	sqlite3_stmt *titleQuery;
-	bool all_albums = album_list_item == 0 || album_list->currentRow() == 0;
-	bool all_artists = artist_list->currentRow() == 0 || artist_list->currentItem() == 0;
-	char *query;
-	if (all_artists) {
-		if (all_albums)
-			query = sqlite3_mprintf("%s", "SELECT `tid`, `title` FROM `tracks` ORDER BY `title` COLLATE NOCASE");
-		else
-			query = sqlite3_mprintf("SELECT `tid`, `track_number`, `title` FROM `tracks` WHERE `album`=%Q ORDER BY `track_number`", qtos(album_list_item->text()));
-	} else {
-		if (all_albums)
-			query = sqlite3_mprintf("SELECT `tid`, `title` FROM `tracks` WHERE `artist`=%Q ORDER BY `title` COLLATE NOCASE", qtos(artist_list->currentItem()->text()));
+	ProfileSpan span("Update album list");
+	int artist = library.artistIndex(artist_model->id(artist_list_index.row())); //NOTE: -1 for [All]
+	if (artist < 0) {
+		if (searching)
+			album_model->setRows(QVector<int>(), QStringList()); //NOTE: just [All], the titles column lists the matches of every artist
 		else
-			query = sqlite3_mprintf("SELECT `tid`, `track_number`, `title` FROM `tracks` WHERE `artist`=%Q AND `album`=%Q ORDER BY `track_number`", qtos(album_list_item->data(Qt::UserRole).toString()), qtos(album_list_item->text()));
+			album_model->setQuery(sqlite3_mprintf("%s", "SELECT 0, `name` FROM `albums` GROUP BY `name` ORDER BY `name`"));
+		album_list->setCurrentIndex(album_model->index(0));
+		return;
 	}
-	prepare(query, &titleQuery, "Failed to Prepare `title` GUI update query: ");
-	bool done = false;
-	titles_list->clear();
-	do {
-		if (step(titleQuery, done, true, "Failed to Step `title` in GUI update: ")) {
-			int tid = sqlite3_column_int(titleQuery, 0);
-			char *title;
-			if (all_albums)
-				title = sqlite3_mprintf("%s", sqlite3_column_text(titleQuery, 1)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
+	QVector<int> ids;
+	QStringList names;
+	library.albums(artist, ids, names, searching ? &search_albums : 0);
+	album_model->setRows(ids, names);
+	int position = library.position(cur_tid);
+	int row = position != -1 && library.artistOf(position) == artist ? album_model->row(library.albumId(library.albumOf(position))) : -1;
+	album_list->setCurrentIndex(album_model->index(row == -1 ? 0 : row));
+}
+
+void Player::updateTitlesList(const QModelIndex &album_list_index, const QModelIndex &prev_album) {
+	if (album_list_index == prev_album)
+		return;
+	ProfileSpan span("Update titles list");
+	int artist = library.artistIndex(artist_model->id(artist_list->currentIndex().row()));
+	int album = library.albumIndex(album_model->id(album_list_index.row())); //NOTE: -1 for [All] and for the albums listed by name under [All]
+	QVector<int> ids;
+	QStringList texts;
+	if (artist >= 0 && album >= 0)
+		library.tracks(album, ids, texts, searching ? &search_tids : 0);
+	else if (searching) { //NOTE: the matches of the artist, or of every artist, in play order
+		QList<int> positions;
+		int tid;
+		foreach(tid, search_tids) {
+			int position = library.position(tid);
+			if (position != -1 && (artist < 0 || library.artistOf(position) == artist))
+				positions.push_back(position);
+		}
+		qSort(positions);
+		int position;
+		foreach(position, positions) {
+			ids.push_back(library.tid(position));
+			texts.push_back(library.title(position));
+		}
+	} else {
+		char *query; //NOTE: the [All] views are not contiguous in play order, they are still paged from the database
+		if (artist < 0) {
+			if (album_list_index.row() <= 0)
+				query = sqlite3_mprintf("%s", "SELECT `tid`, `title` FROM `tracks` ORDER BY `title` COLLATE NOCASE");
 			else
-				title = sqlite3_mprintf("%d. %s", sqlite3_column_int(titleQuery, 1), sqlite3_column_text(titleQuery, 2)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-			QListWidgetItem *new_item = new QListWidgetItem(title);
-			new_item->setData(Qt::UserRole, tid);
-			if (track_queue.contains(tid))
-				new_item->setIcon(*queued);
-			titles_list->addItem(new_item);
-			sqlite3_free(title);
+				query = sqlite3_mprintf("SELECT `tid`, `track_number` || '. ' || `title` FROM `albums` JOIN `tracks` ON `album_id`=`alid` WHERE `name`=%Q ORDER BY `track_number`", qtos(album_model->text(album_list_index.row())));
 		}
-	} while (!done);
-	if (cur_artist == artist_list->currentItem() && album_list_item == album_list->item(cur_album))
-		titles_list->setCurrentRow(cur_title);
-	else
-		titles_list->setCurrentRow(0);
+		else
+			query = sqlite3_mprintf("SELECT `tid`, `title` FROM `tracks` WHERE `artist_id`=%d ORDER BY `title` COLLATE NOCASE", library.artistId(artist));
+		titles_model->setQuery(query);
+		pending_title_row = 0; //NOTE: selected when the first page comes back
+		return;
+	}
+	pending_title_row = -1;
+	titles_model->setRows(ids, texts);
+	int row = titles_model->row(cur_tid);
+	titles_list->setCurrentIndex(titles_model->index(row == -1 ? 0 : row));
 }
 
-void Player::showTrackInfo(QListWidgetItem *titles_list_item, QListWidgetItem *) {
-	if (titles_list_item == 0)
+void Player::titlesFetched() {
+	if (pending_title_row == -1)
 		return;
-	sqlite3_stmt *trackQuery = 0;
-	char *query = sqlite3_mprintf("SELECT `artist`, `year`, `album`, `track_number`, `title` FROM `tracks` WHERE `tid`=%u LIMIT 1", titles_list_item->data(Qt::UserRole).toInt());
-	prepare(query, &trackQuery, "Failed to Prepare status bar update query: ");
-	bool done = false;
-	do {
-		if (step(trackQuery, done, true, "Failed to Step in status bar update: ")) {
-			char *track_text = sqlite3_mprintf("%s - %u - %s - %u - %s", sqlite3_column_text(trackQuery, 0), sqlite3_column_int(trackQuery, 1), sqlite3_column_text(trackQuery, 2), sqlite3_column_int(trackQuery, 3), sqlite3_column_text(trackQuery, 4));
-			statusBar()->changeItem(track_text, SONG_NAME);
-			sqlite3_free(track_text);
-		}
-	} while (!done);
+	if (titles_model->hasRow(pending_title_row))
+		titles_list->setCurrentIndex(titles_model->index(pending_title_row));
+	else if (titles_model->atEnd())
+		titles_list->setCurrentIndex(titles_model->index(titles_model->rowCount() - 1));
+	else {
+		titles_model->fetchMore(QModelIndex()); //NOTE: the row is further down than the view has scrolled
+		return;
+	}
+	pending_title_row = -1;
+}
+
+void Player::coverRead(int alid) {
+	album_model->updateId(alid);
+	if (alid == mw_alid)
+		showCover();
+}
+
+void Player::coversLoaded() {
+	album_model->updateDecorations();
+	showCover();
+}
+
+void Player::showCover() {
+	mw_cover->setPixmap(covers->cover(mw_alid, CoverCache::Large)); //NOTE: cleared until it has been read
+}
+
+void Player::showTrackInfo(const QModelIndex &titles_list_index, const QModelIndex &) {
+	if (!titles_list_index.isValid())
+		return;
+	int position = library.position(titles_model->id(titles_list_index.row()));
+	if (position == -1)
+		return;
+	QString track_text = QString("%1 - %2 - %3 - %4 - %5").arg(library.artistName(library.artistOf(position))).arg(library.year(position)).arg(library.albumName(library.albumOf(position))).arg(library.trackNumber(position)).arg(library.title(position));
+	statusBar()->changeItem(track_text, SONG_NAME);
 }
 
 void Player::keyReleaseEvent(QKeyEvent *event) {
 	switch(event->key()) {
 		case Qt::Key_Delete:
 		case Qt::Key_Backspace: {
-			enum { AllTracksLevel, ArtistLevel, AlbumLevel, TrackLevel } delete_level = TrackLevel;
+			if (!artist_list->hasFocus() && !album_list->hasFocus() && !titles_list->hasFocus()) //NOTE: editing the search text also ends up here
+				break;
+			if (searching && !titles_list->hasFocus()) //NOTE: the columns only list the matches, deleting an artist or album from there would delete tracks that aren't shown
+				break;
+			DeleteLevel delete_level = TrackLevel;
+			int artist_row = artist_list->currentIndex().row();
+			int album_row = album_list->currentIndex().row();
+			int title_row = titles_list->currentIndex().row();
+			bool single_album = !album_model->hasRow(2);
 			if (artist_list->hasFocus()) {
-				if (artist_list->currentRow() == 0)
+				if (artist_row == 0)
 					delete_level = AllTracksLevel;
 				else
 					delete_level = ArtistLevel;
 			} else if (album_list->hasFocus()) {
-				if (album_list->currentRow() == 0 || album_list->count() == 2)
+				if (album_row == 0 || single_album)
 					delete_level = ArtistLevel;
 				else
 					delete_level = AlbumLevel;
 			} else if (titles_list->hasFocus()) {
-				if (titles_list->count() == 1) {
-					if (album_list->count() == 2)
+				if (!titles_model->hasRow(1) && !titles_model->atEnd()) //NOTE: the titles are still on their way, don't take a short column for a single track
+					break;
+				if (!searching && !titles_model->hasRow(1)) {
+					if (single_album)
 						delete_level = ArtistLevel;
 					else
 						delete_level = AlbumLevel;
@@ -763,149 +1314,50 @@ void Player::keyReleaseEvent(QKeyEvent *event) {
 				else
 					delete_level = TrackLevel;
 			}
-			sqlite3_stmt *deleteQuery;
+			int aid = artist_model->id(artist_row);
 			char *query;
 			switch (delete_level) {
 				case AllTracksLevel: query = sqlite3_mprintf("%s", "DELETE FROM `tracks`"); break;
-				case ArtistLevel:    query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `artist`=%Q", qtos(artist_list->currentItem()->text())); break;
-				case AlbumLevel:     query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `artist`=%Q AND `album`=%Q", qtos(artist_list->currentItem()->text()), qtos(album_list->currentItem()->text())); break;
-				case TrackLevel:     query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `tid`=%d", titles_list->currentItem()->data(Qt::UserRole).toInt()); break;
-			}
-			prepare(query, &deleteQuery, "Failed to Prepare DELETE query: ");
-			bool done = false; //NOTE: value ignored for the case of a DELETE query, but required for the use of the the `step` convenience function
-			step(deleteQuery, done, true, "Failed to Step DELETE: ");
-			switch (delete_level) {
-				case AllTracksLevel:
-					artist_list->clear();
-					artist_list->addItem(ALL);
-					cur_artist = artist_list->item(0);
-					album_list->clear();
-					cur_album = 0;
-					titles_list->clear();
-					cur_title = 0;
-					statusBar()->changeItem("", SONG_NAME);
-					artist_list->setCurrentItem(artist_list->item(0));
-					break;
-				case ArtistLevel: {
-					int row = artist_list->currentRow();
-					bool update_cur_artist = cur_artist == artist_list->currentItem();
-					delete artist_list->takeItem(row);
-					row = row == artist_list->count() ? artist_list->count() - 1 : row;
-					if (update_cur_artist) {
-						cur_artist = artist_list->item(row);
-						cur_album = 1;
-						cur_title = 0;
-					}
-					artist_list->setCurrentItem(artist_list->item(row), 0);
-					break;
-				}
-				case AlbumLevel: {
-					int row = album_list->currentRow();
-					bool update_cur_album = cur_artist == artist_list->currentItem() && cur_album == row;
-					updateAlbumList(artist_list->currentItem());
-					row = row == album_list->count() ? album_list->count() - 1 : row;
-					if (update_cur_album) {
-						cur_album = row;
-						cur_title = 0;
-					}
-					album_list->setCurrentRow(row);
-					break;
-				}
-				case TrackLevel: {
-					int row = titles_list->currentRow();
-					bool update_cur_title = cur_artist == artist_list->currentItem() && cur_album == album_list->currentRow() && cur_title == row;
-					updateTitlesList(album_list->currentItem());
-					row = row == titles_list->count() ? titles_list->count() - 1 : row;
-					if (update_cur_title)
-						cur_title = row;
-					titles_list->setCurrentRow(row);
-					break;
-				}
+				case ArtistLevel:    query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `artist_id`=%d", aid); break;
+				case AlbumLevel:     query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `album_id`=%d", album_model->id(album_row)); break;
+				case TrackLevel:     query = sqlite3_mprintf("DELETE FROM `tracks` WHERE `tid`=%d", titles_model->id(title_row)); break;
 			}
+			database->post(new ExecTask(query, "Failed to Step DELETE: "));
+			LoadLibraryTask *load = new LoadLibraryTask(database, snapshot_path, LoadLibraryTask::Rows); //NOTE: runs after the DELETE, tasks run in the order they are posted
+			load->position = library.position(cur_tid);
+			load->delete_level = delete_level;
+			load->artist_row = artist_row;
+			load->album_row = album_row;
+			load->title_row = title_row;
+			reloadLibrary(load);
 			break;
 		}
 		default: break;
 	}
 }
 
-void Player::prepare(char *query, sqlite3_stmt **stmt, const char *failure_msg) {
-	int return_code = sqlite3_prepare_v2(tracks_db, query, -1, stmt, 0);
-	if (return_code) {
-		showError(failure_msg, sqlite3_errmsg(tracks_db));
-		exit(return_code);
-	}
-	sqlite3_free(query);
-}
-
-bool Player::step(sqlite3_stmt *stmt, bool &done, bool finalize, const char *failure_msg) {
-	int return_code = sqlite3_step(stmt);
-	switch (return_code) {
-		case SQLITE_ROW:
-			return true;
-		case SQLITE_DONE:
-			done = true;
-			if (finalize)
-				sqlite3_finalize(stmt);
-			else
-				sqlite3_reset(stmt);
-			return false;
-		default:
-			done = true;
-			if (finalize)
-				sqlite3_finalize(stmt);
-			else
-				sqlite3_reset(stmt);
-			showError(failure_msg, sqlite3_errmsg(tracks_db));
-			exit(return_code);
-			return false;
-	}
-}
-
 void Player::showError(QString part1, QString part2) {
 	KMessageBox::error(this, part1 + part2);
 }
 
-void Player::setQLabelText(const char *format, sqlite3_stmt *stmt, int index, QLabel *label) {
-	char *text = sqlite3_mprintf(format, sqlite3_column_text(stmt, index));
-	label->setText(text);
-	sqlite3_free(text);
+void Player::fatalError(const QString &part1, const QString &part2) {
+	showError(part1, part2);
+	DatabaseWorker *worker = qobject_cast<DatabaseWorker *>(sender());
+	exit(worker ? worker->errorCode() : database->errorCode());
 }
 
 void Player::selectTrack(int tid) {
-	char *query = sqlite3_mprintf("SELECT `artist`, `album`, `title` FROM `tracks` WHERE `tid`=%u", tid);
-	sqlite3_stmt *selectQuery = 0;
-	prepare(query, &selectQuery, "Failed to Prepare selectTrack query: ");
-	bool done = false;
-	if (step(selectQuery, done, true, "Failed to Step select in selectTrack: ")) {
-		char *artist_name = sqlite3_mprintf("%s", sqlite3_column_text(selectQuery, 0)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-		QListWidgetItem *artist = artist_list->findItems(artist_name, Qt::MatchCaseSensitive).takeFirst();
-		sqlite3_free(artist_name);
-		artist_list->setCurrentItem(artist);
-		char *album_name = sqlite3_mprintf("%s", sqlite3_column_text(selectQuery, 1)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-		QListWidgetItem *album = album_list->findItems(album_name, Qt::MatchCaseSensitive).takeFirst();
-		sqlite3_free(album_name);
-		album_list->setCurrentItem(album);
-		char *track_name = sqlite3_mprintf("%s", sqlite3_column_text(selectQuery, 2)); //NOTE: why does sqlite3_column_text return an `unsigned char *`?  who uses that?!
-		QList<QListWidgetItem *> tracks = titles_list->findItems(track_name, Qt::MatchEndsWith);
-		sqlite3_free(track_name);
-		QListWidgetItem *item, *title = 0;
-		foreach(item, tracks) { //NOTE: loop through the found items to prevent the case of selecting the wrong track with the same name
-			if (item->data(Qt::UserRole).toInt() == tid) {
-				title = item;
-				break;
-			}
-		}
-		titles_list->setCurrentItem(title);
-	}
-}
-
-void Player::updateNumTracks() {
-	char *query = sqlite3_mprintf("%s", "SELECT count(*) FROM `tracks`");
-	sqlite3_stmt *countQuery = 0;
-	prepare(query, &countQuery, "Failed to Prepare `count(*)` query: ");
-	bool done = false;
-	if (step(countQuery, done, true, "Failed to Step `count(*)` in constructor: "))
-		num_tracks = sqlite3_column_int(countQuery, 0);
-	else
-		num_tracks = 0;
+	int position = library.position(tid);
+	if (position == -1)
+		return;
+	int row = artist_model->row(library.artistId(library.artistOf(position)));
+	if (row == -1) //NOTE: hidden by the search
+		return;
+	artist_list->setCurrentIndex(artist_model->index(row));
+	row = album_model->row(library.albumId(library.albumOf(position)));
+	if (row != -1)
+		album_list->setCurrentIndex(album_model->index(row));
+	row = titles_model->row(tid);
+	if (row != -1)
+		titles_list->setCurrentIndex(titles_model->index(row));
 }
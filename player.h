@@ -5,13 +5,19 @@
 #include <QHash>
 #include <QLabel>
 #include <QList>
-#include <QLinkedList>
+#include <QListView>
 #include <QListWidgetItem>
+#include <QModelIndex>
+#include <QProgressBar>
+#include <QSet>
 #include <QStringList>
+#include <QTimer>
 #include <QWidget>
 
 #include <KAction>
 #include <KConfig>
+#include <KDirWatch>
+#include <KLineEdit>
 #include <KListWidget>
 #include <KPushButton>
 #include <KSystemTrayIcon>
@@ -21,12 +27,29 @@
 
 #include <sqlite3.h>
 
-struct HistoryItem {
-	HistoryItem(QListWidgetItem *q, int a, int t, int i) : artist(q), album(a), title(t), tid(i) {};
-	QListWidgetItem *artist;
-	int album, title, tid;
+#include "browsemodel.h"
+#include "covercache.h"
+#include "databaseworker.h"
+#include "importer.h"
+#include "lengthscanner.h"
+#include "libraryindex.h"
+#include "profilewindow.h"
+#include "shufflebag.h"
+#include "searchworker.h"
+#include "statswindow.h"
+#include "trackhistory.h"
+#include "trackqueue.h"
+
+struct UpcomingTrack {
+	enum Source {Queued, Shuffled, Sequential}; //NOTE: what next() has to consume when the track is played
+	Source source;
+	int tid;
+	QString artist, year, album, track_number, title, path;
 };
 
+class ImportTask;
+class LoadLibraryTask;
+
 class Player : public KXmlGuiWindow
 {
 	Q_OBJECT 
@@ -40,29 +63,51 @@ class Player : public KXmlGuiWindow
 		
 		void loadFiles();
 		void loadDirectory();
+		void libraryPathChanged(const QString &);
+		void syncLibrary();
+		void updateImportProgress();
+		void cancelImports();
+		void resumeImports();
+		void importsRead(DatabaseTask *);
+		void importFinished(DatabaseTask *);
+		void missingLengthsRead(DatabaseTask *);
+		void writeLengths();
+		void playbackStateChanged(Phonon::State);
 		
 		void enqueueNext();
 		
 		void previous();
 		void pause();
 		void play();
-		void play(QListWidgetItem *);
+		void play(const QModelIndex &);
 		void next();
 		void queue();
+		void queueAlbum();
+		void queueArtist();
 		void shuffle(bool);
 		void updateDuration(qint64);
 		void tick(qint64);
+		void sourceChanged();
+		void flushPlaycounts();
+		void fillLookahead();
+		void startSearch();
+		void applySearch();
+		void searchFailed(const QString &, const QString &);
+		void libraryLoaded(DatabaseTask *);
+		void titlesFetched();
+		void coverRead(int);
+		void coversLoaded();
 		
-		void updateArtistList(QListWidgetItem *);
-		void updateAlbumList(QListWidgetItem *, QListWidgetItem * = 0);
-		void updateTitlesList(QListWidgetItem *, QListWidgetItem * = 0);
-		void showTrackInfo(QListWidgetItem *, QListWidgetItem * = 0);
+		void updateAlbumList(const QModelIndex &, const QModelIndex & = QModelIndex());
+		void updateTitlesList(const QModelIndex &, const QModelIndex & = QModelIndex());
+		void showTrackInfo(const QModelIndex &, const QModelIndex & = QModelIndex());
 		
 		void viewCurrentTrack();
 		void viewTrackDetails();
 		void hideTrackDetails();
 		void viewTrackQueue();
 		void hideTrackQueue();
+		void viewStatistics();
 		void viewPlaylist(bool);
 		
 		void moveQueuedTrackToTop();
@@ -71,40 +116,87 @@ class Player : public KXmlGuiWindow
 		void moveQueuedTrackToBottom();
 		void dequeueTrack();
 		
+		void fatalError(const QString &, const QString &);
+		
 	protected:
 		void keyReleaseEvent(QKeyEvent *);
 		
 	private:
 		void cleanup();
 		inline KAction* setupKAction(const char *, QString, QString, const char *);
-		void readDirectory(const QDir &, QStringList &);
-		void loadFiles(const QStringList &);
+		inline QListView* setupListView(BrowseModel *, QWidget *);
+		void startImport(ImportTask *, bool);
+		void queueTracks(int, int);
 		void next(bool);
 		void play(int, bool = true, bool = true);
-		inline void prepare(char *, sqlite3_stmt **, const char *);
-		inline bool step(sqlite3_stmt *, bool &, bool, const char *);
 		inline void showError(QString, QString);
-		inline void setQLabelText(const char *, sqlite3_stmt *, int, QLabel *);
+		void reloadLibrary(LoadLibraryTask *);
+		void resumePlayback();
+		void reselectRows(const LoadLibraryTask *);
+		void selectArtist(int);
 		void selectTrack(int);
-		void updateNumTracks();
+		void startLengthScanner();
+		void pauseLengthScanner();
+		void countPlay();
+		void playTrack(const UpcomingTrack &, bool = true, bool = true);
+		void showTrack(const UpcomingTrack &, bool);
+		void resolveUpcoming(int);
+		bool resolveTrack(int, UpcomingTrack &);
+		void invalidateLookahead();
+		void fillArtistList();
+		void refillAlbumList();
+		void showCover();
+		void indexSearchMatches();
 		
-		sqlite3 *tracks_db;
+		DatabaseWorker *database, *import_database; //NOTE: `import_database` runs the imports and the journal, nothing else
+		QString snapshot_path;
 		KSharedConfigPtr config;
 		QWidget *playlist_widget, *metadata_window, *queue_window;
-		KAction *shuffleAction, *viewPlaylistAction;
-		QLabel *mw_artist, *mw_year, *mw_album, *mw_track_number, *mw_title, *mw_path;
+		KAction *shuffleAction, *viewPlaylistAction, *resumeImportsAction;
+		QLabel *mw_artist, *mw_year, *mw_album, *mw_track_number, *mw_title, *mw_path, *mw_cover;
+		int mw_alid; //NOTE: the album of the track in the details window
 		KPushButton *mw_ok_button, *qw_ok_button;
 		QLabel *cur_time, *track_duration;
-		KListWidget *artist_list, *album_list, *titles_list, *qw_queue_list;
-		QListWidgetItem *cur_artist;
-		int cur_album, cur_title, num_tracks;
+		QListView *artist_list, *album_list, *titles_list;
+		BrowseModel *artist_model, *album_model, *titles_model;
+		KListWidget *qw_queue_list;
+		StatsWindow *stats_window;
+		ProfileWindow *profile_window;
+		LibraryIndex library;
+		ShuffleBag shuffle_bag;
+		int cur_tid;
 		bool shuffle_tracks;
 		Phonon::MediaObject *now_playing;
-		QList<int> track_queue; //a queue ... push_back to add ... takeFirst to retrieve
-		QHash<int, QString> track_queue_info;
+		TrackQueue track_queue;
 		KIcon *queued, dequeud;
-		QLinkedList<HistoryItem> history; //a stack ... push_back to add ... takeLast to retrieve next
+		TrackHistory history;
 		KSystemTrayIcon *tray_icon;
+		KDirWatch *library_watch;
+		QTimer *sync_timer;
+		QStringList library_dirs; //NOTE: the directories passed to loadDirectory, watched for changes
+		QSet<QString> dirty_dirs;
+		int importing; //NOTE: imports posted and not finished yet
+		QList<ImportTask *> running_imports; //NOTE: the imports the status bar is showing, in the order they run, owned by the import worker
+		QProgressBar *import_progress;
+		KPushButton *import_cancel_button;
+		QTimer *import_timer;
+		LengthScanner *length_scanner;
+		CoverCache *covers;
+		QHash<int, int> pending_plays; //NOTE: `tid` -> plays not yet written to `playcount`
+		QTimer *playcount_timer;
+		int playing_tid, playcount_threshold, lookahead_depth;
+		bool play_counted;
+		qint64 cur_duration;
+		QList<UpcomingTrack> upcoming; //NOTE: the next tracks, resolved ahead of time so aboutToFinish only has to enqueue a path
+		UpcomingTrack next_track; //NOTE: enqueued in Phonon, not playing yet
+		QTimer *lookahead_timer;
+		KLineEdit *search_edit;
+		QTimer *search_timer;
+		SearchWorker *search_worker;
+		QString search_text; //NOTE: of the matches shown
+		QSet<int> search_tids, search_artists, search_albums; //NOTE: matching `tid`s, and the artist and album indexes they are in
+		bool searching;
+		int pending_title_row; //NOTE: the title row to select once it has been fetched, -1 for none
 };
 
 #endif
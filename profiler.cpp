@@ -0,0 +1,194 @@
+#include "profiler.h"
+
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QStringList>
+#include <QTextStream>
+#include <QThread>
+#include <QVector>
+#include <QtAlgorithms>
+
+#include <string.h>
+
+const int MAX_TRACE_EVENTS = 262144; //NOTE: a ring, the oldest spans are overwritten
+
+struct TraceEvent {
+	QString label;
+	qint64 start, duration;
+	int thread;
+};
+
+static QMutex mutex;
+static QElapsedTimer timer;
+static QHash<const char *, QString> names; //NOTE: literal labels, converted once
+static QHash<QString, ProfileStats> label_stats;
+static QVector<TraceEvent> trace;
+static int next_event = 0;
+static QHash<Qt::HANDLE, int> thread_ids;
+static QStringList thread_names;
+
+QAtomicInt Profiler::recording(0);
+
+static int bucket(qint64 micros) {
+	if (micros < 4)
+		return qMax(int(micros), 0);
+	int power = 2;
+	while (micros >> (power + 1))
+		++power;
+	return qMin(4 * (power - 1) + int((micros >> (power - 2)) & 3), NUM_PROFILE_BUCKETS - 1);
+}
+
+static qint64 bucketStart(int bucket) {
+	return bucket < 4 ? bucket : qint64(4 + bucket % 4) << (bucket / 4 - 1);
+}
+
+static bool totalAfter(const ProfileStats &a, const ProfileStats &b) {
+	return a.total > b.total;
+}
+
+static int threadId() {
+	Qt::HANDLE handle = QThread::currentThreadId();
+	QHash<Qt::HANDLE, int>::const_iterator itt = thread_ids.constFind(handle);
+	if (itt != thread_ids.constEnd())
+		return itt.value();
+	QThread *thread = QThread::currentThread();
+	QCoreApplication *app = QCoreApplication::instance();
+	thread_names.push_back(app && thread == app->thread() ? QString("GUI") : QString(thread->metaObject()->className()));
+	thread_ids.insert(handle, thread_names.count() - 1);
+	return thread_names.count() - 1;
+}
+
+static QString jsonString(const QString &text) {
+	QString escaped = text;
+	escaped.replace('\\', "\\\\").replace('"', "\\\"");
+	return '"' + escaped + '"';
+}
+
+bool Profiler::isRecording() {
+	return recording != 0;
+}
+
+void Profiler::setRecording(bool record) {
+	QMutexLocker lock(&mutex);
+	if (!timer.isValid())
+		timer.start(); //NOTE: before the flag, a span that sees the flag has a timer to read
+	recording.fetchAndStoreRelease(record ? 1 : 0); //NOTE: publishes the started timer
+}
+
+void Profiler::reset() {
+	QMutexLocker lock(&mutex);
+	label_stats.clear();
+	trace.clear();
+	next_event = 0;
+	thread_ids.clear();
+	thread_names.clear();
+}
+
+QList<ProfileStats> Profiler::stats() {
+	QList<ProfileStats> all;
+	{
+		QMutexLocker lock(&mutex);
+		all = label_stats.values();
+	}
+	qSort(all.begin(), all.end(), totalAfter);
+	return all;
+}
+
+qint64 Profiler::percentile(const ProfileStats &stats, int percent) {
+	qint64 rank = (stats.count * percent + 99) / 100, seen = 0;
+	for (int i = 0; i < NUM_PROFILE_BUCKETS; ++i) {
+		seen += stats.buckets[i];
+		if (seen >= rank && seen > 0)
+			return qMin(bucketStart(i + 1), (stats.max + 999) / 1000); //NOTE: the top bucket is open ended, the maximum bounds it
+	}
+	return 0;
+}
+
+QString Profiler::displayLabel(const QString &label) {
+	QString display = label;
+	if (display.startsWith("Failed to "))
+		display.remove(0, 10);
+	if (display.endsWith(": "))
+		display.chop(2);
+	if (!display.isEmpty())
+		display[0] = display.at(0).toUpper();
+	return display;
+}
+
+bool Profiler::writeTrace(const QString &path) {
+	QVector<TraceEvent> events;
+	QStringList threads;
+	int oldest;
+	{
+		QMutexLocker lock(&mutex);
+		events = trace;
+		threads = thread_names;
+		oldest = events.count() < MAX_TRACE_EVENTS ? 0 : next_event;
+	}
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate))
+		return false;
+	QTextStream out(&file);
+	out.setCodec("UTF-8");
+	out.setRealNumberNotation(QTextStream::FixedNotation);
+	out.setRealNumberPrecision(3);
+	out << "{\"traceEvents\":[\n";
+	for (int i = 0; i < threads.count(); ++i)
+		out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << i << ",\"args\":{\"name\":" << jsonString(threads.at(i)) << "}},\n";
+	QHash<QString, QString> labels; //NOTE: each label is escaped once, not once per span
+	for (int i = 0; i < events.count(); ++i) {
+		const TraceEvent &event = events.at((oldest + i) % events.count());
+		QHash<QString, QString>::iterator label = labels.find(event.label);
+		if (label == labels.end())
+			label = labels.insert(event.label, jsonString(displayLabel(event.label)));
+		out << "{\"name\":" << label.value() << ",\"cat\":\"projekt7\",\"ph\":\"X\",\"pid\":1,\"tid\":" << event.thread
+		    << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "},\n";
+	}
+	out << "{}],\"displayTimeUnit\":\"ms\"}\n"; //NOTE: the empty event saves special casing the last comma
+	out.flush();
+	return file.error() == QFile::NoError;
+}
+
+qint64 Profiler::now() {
+	return timer.nsecsElapsed();
+}
+
+void Profiler::record(const char *name, const QString *text, qint64 start) {
+	qint64 duration = timer.nsecsElapsed() - start;
+	QString label;
+	if (text)
+		label = *text;
+	QMutexLocker lock(&mutex);
+	if (!recording) //NOTE: switched off while the span ran
+		return;
+	if (name) {
+		QHash<const char *, QString>::iterator itt = names.find(name);
+		if (itt == names.end())
+			itt = names.insert(name, QString::fromLatin1(name));
+		label = itt.value();
+	}
+	QHash<QString, ProfileStats>::iterator stats = label_stats.find(label);
+	if (stats == label_stats.end()) {
+		ProfileStats fresh;
+		fresh.label = label;
+		fresh.count = 0;
+		fresh.total = 0;
+		fresh.max = 0;
+		memset(fresh.buckets, 0, sizeof(fresh.buckets));
+		stats = label_stats.insert(label, fresh);
+	}
+	++stats->count;
+	stats->total += duration;
+	stats->max = qMax(stats->max, duration);
+	++stats->buckets[bucket(duration / 1000)];
+	TraceEvent event = {label, start, duration, threadId()};
+	if (trace.count() < MAX_TRACE_EVENTS)
+		trace.push_back(event);
+	else
+		trace[next_event] = event;
+	next_event = (next_event + 1) % MAX_TRACE_EVENTS;
+}
@@ -0,0 +1,58 @@
+#ifndef _PROFILER_H_
+#define _PROFILER_H_
+
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+
+const int NUM_PROFILE_BUCKETS = 160;
+
+struct ProfileStats {
+	QString label;
+	qint64 count, total, max; //NOTE: `total` and `max` in nanoseconds
+	int buckets[NUM_PROFILE_BUCKETS]; //NOTE: durations in microseconds, four buckets per power of two
+};
+
+/*
+ * Timing for the hot paths: every query, list fill and import stage runs inside a ProfileSpan named after
+ * the failure message of the code it times.  While recording, each span that ends is added to a histogram
+ * for its label and to a trace of the latest spans, which can be saved in Chrome's trace event format and
+ * opened in chrome://tracing.  Recording starts switched off unless PROJEKT7_PROFILE is set, and a span
+ * then costs one relaxed load of a flag, which is why the span itself is all inline.
+ */
+class Profiler
+{
+	public:
+		static bool isRecording();
+		static void setRecording(bool);
+		static void reset();
+		static QList<ProfileStats> stats(); //NOTE: by total time spent, most first
+		static qint64 percentile(const ProfileStats &, int); //NOTE: microseconds, the upper edge of the bucket it falls in
+		static QString displayLabel(const QString &); //NOTE: "Failed to Step search: " reads "Step search"
+		static bool writeTrace(const QString &);
+	
+	private:
+		friend class ProfileSpan;
+		static qint64 now();
+		static void record(const char *, const QString *, qint64);
+		
+		static QAtomicInt recording; //NOTE: 0 or 1, read by every thread's spans, its plain reads (operator int, !=, !) are relaxed loads
+};
+
+/*
+ * Times the scope it is declared in.  A QString label is read when the span ends, so it has to outlive it.
+ */
+class ProfileSpan
+{
+	public:
+		ProfileSpan(const char *label) : name(label), text(0), start(Profiler::recording != 0 ? Profiler::now() : -1) {}
+		ProfileSpan(const QString &label) : name(0), text(&label), start(Profiler::recording != 0 ? Profiler::now() : -1) {}
+		~ProfileSpan() { if (start != -1) Profiler::record(name, text, start); }
+	
+	private:
+		const char *name;
+		const QString *text;
+		qint64 start;
+};
+
+#endif
@@ -0,0 +1,101 @@
+#include "profilewindow.h"
+#include "profiler.h"
+
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QHeaderView>
+#include <QStringList>
+
+#include <KFileDialog>
+#include <KIcon>
+#include <KMessageBox>
+#include <KUrl>
+
+enum ProfileColumn {LabelColumn, CountColumn, TotalColumn, MeanColumn, P50Column, P90Column, P99Column, MaxColumn, NUM_COLUMNS};
+
+ProfileWindow::ProfileWindow(QWidget *parent) : QWidget(parent, Qt::Dialog) {
+	setWindowTitle("Profiler  |  Projekt 7");
+	record_box = new QCheckBox("Record", this);
+	reset_button = new KPushButton(KIcon("edit-clear"), "Reset", this);
+	save_button = new KPushButton(KIcon("document-save"), "Save Trace...", this);
+	ok_button = new KPushButton(KIcon("dialog-ok-apply"), "OK", this);
+	ok_button->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Fixed);
+	spans = new QTreeWidget(this);
+	spans->setRootIsDecorated(false);
+	spans->setColumnCount(NUM_COLUMNS);
+	spans->setHeaderLabels(QStringList() << "Span" << "Count" << "Total ms" << "Mean us" << "p50 us" << "p90 us" << "p99 us" << "Max us");
+	spans->header()->setResizeMode(LabelColumn, QHeaderView::Stretch);
+	spans->setSortingEnabled(true);
+	spans->sortByColumn(TotalColumn, Qt::DescendingOrder);
+	refresh_timer = new QTimer(this);
+	refresh_timer->setInterval(1000);
+	
+	QHBoxLayout *buttons_layout = new QHBoxLayout;
+	buttons_layout->addWidget(record_box);
+	buttons_layout->addStretch();
+	buttons_layout->addWidget(reset_button);
+	buttons_layout->addWidget(save_button);
+	
+	QGridLayout *pwLayout = new QGridLayout;
+	pwLayout->addLayout(buttons_layout, 0, 0);
+	pwLayout->addWidget(spans, 1, 0);
+	pwLayout->addWidget(ok_button, 2, 0, Qt::AlignCenter);
+	setLayout(pwLayout);
+	resize(720, 400);
+	
+	connect(record_box,    SIGNAL(toggled(bool)), this, SLOT(setRecording(bool)));
+	connect(reset_button,  SIGNAL(clicked()),     this, SLOT(reset()));
+	connect(save_button,   SIGNAL(clicked()),     this, SLOT(saveTrace()));
+	connect(ok_button,     SIGNAL(clicked()),     this, SLOT(hide()));
+	connect(refresh_timer, SIGNAL(timeout()),     this, SLOT(refresh()));
+}
+
+void ProfileWindow::refresh() {
+	record_box->setChecked(Profiler::isRecording());
+	spans->setSortingEnabled(false); //NOTE: rows are sorted once they are all in, not as each one is added
+	spans->clear();
+	ProfileStats stats;
+	foreach(stats, Profiler::stats()) {
+		QTreeWidgetItem *item = new QTreeWidgetItem(spans);
+		item->setText(LabelColumn, Profiler::displayLabel(stats.label));
+		item->setToolTip(LabelColumn, stats.label);
+		item->setData(CountColumn, Qt::DisplayRole, stats.count); //NOTE: numbers, not text, so the columns sort numerically
+		item->setData(TotalColumn, Qt::DisplayRole, stats.total / 1000000);
+		item->setData(MeanColumn,  Qt::DisplayRole, stats.count > 0 ? stats.total / stats.count / 1000 : 0);
+		item->setData(P50Column,   Qt::DisplayRole, Profiler::percentile(stats, 50));
+		item->setData(P90Column,   Qt::DisplayRole, Profiler::percentile(stats, 90));
+		item->setData(P99Column,   Qt::DisplayRole, Profiler::percentile(stats, 99));
+		item->setData(MaxColumn,   Qt::DisplayRole, stats.max / 1000);
+		for (int column = CountColumn; column < NUM_COLUMNS; ++column)
+			item->setTextAlignment(column, Qt::AlignRight | Qt::AlignVCenter);
+	}
+	spans->setSortingEnabled(true);
+}
+
+void ProfileWindow::showEvent(QShowEvent *event) {
+	refresh();
+	refresh_timer->start();
+	QWidget::showEvent(event);
+}
+
+void ProfileWindow::hideEvent(QHideEvent *event) {
+	refresh_timer->stop();
+	QWidget::hideEvent(event);
+}
+
+void ProfileWindow::setRecording(bool record) {
+	Profiler::setRecording(record);
+}
+
+void ProfileWindow::reset() {
+	Profiler::reset();
+	refresh();
+}
+
+void ProfileWindow::saveTrace() {
+	QString path = KFileDialog::getSaveFileName(KUrl(), "*.json|Chrome Trace (*.json)", this);
+	if (path.isEmpty())
+		return;
+	if (!Profiler::writeTrace(path))
+		KMessageBox::error(this, "Failed to save the trace to " + path);
+}
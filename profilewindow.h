@@ -0,0 +1,42 @@
+#ifndef _PROFILEWINDOW_H_
+#define _PROFILEWINDOW_H_
+
+#include <QCheckBox>
+#include <QTimer>
+#include <QTreeWidget>
+#include <QWidget>
+
+#include <KPushButton>
+
+/*
+ * The Profiler's histograms, one row per span label: how often it ran, the time spent in it and its latency
+ * percentiles.  Refreshed every second while shown, it doesn't block the player so the numbers can be
+ * watched while reproducing a stutter.  The trace of the latest spans is saved from here too.
+ */
+class ProfileWindow : public QWidget
+{
+	Q_OBJECT
+	
+	public:
+		ProfileWindow(QWidget *parent = 0);
+	
+	public slots:
+		void refresh();
+	
+	protected:
+		void showEvent(QShowEvent *);
+		void hideEvent(QHideEvent *);
+	
+	private slots:
+		void setRecording(bool);
+		void reset();
+		void saveTrace();
+	
+	private:
+		QCheckBox *record_box;
+		QTreeWidget *spans;
+		KPushButton *reset_button, *save_button, *ok_button;
+		QTimer *refresh_timer;
+};
+
+#endif
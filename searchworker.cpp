@@ -0,0 +1,126 @@
+#include "searchworker.h"
+#include "profiler.h"
+
+#include <QMutexLocker>
+#include <QStringList>
+
+#include <string>
+
+SearchWorker::SearchWorker(const QString &db_path, int limit, QObject *parent) : QThread(parent), db_path(db_path), limit(qMax(limit, 1)), has_pending(false), has_results(false), querying(false), stopped(false), db(0) {
+}
+
+SearchWorker::~SearchWorker() {
+	stop();
+	wait();
+}
+
+void SearchWorker::search(const QString &text) {
+	QMutexLocker lock(&mutex);
+	pending_text = text;
+	has_pending = true;
+	if (querying && db)
+		sqlite3_interrupt(db); //NOTE: safe from another thread, the interrupted statement returns SQLITE_INTERRUPT
+	wake.wakeOne();
+}
+
+void SearchWorker::stop() {
+	QMutexLocker lock(&mutex);
+	stopped = true;
+	if (querying && db)
+		sqlite3_interrupt(db);
+	wake.wakeOne();
+}
+
+bool SearchWorker::take(QString &text, QList<int> &tids) {
+	QMutexLocker lock(&mutex);
+	if (!has_results)
+		return false;
+	text = result_text;
+	tids = result_tids;
+	has_results = false;
+	return true;
+}
+
+QString SearchWorker::matchExpression(const QString &text) {
+	QStringList terms;
+	QString word;
+	foreach(word, text.split(' ', QString::SkipEmptyParts)) {
+		word.replace('"', "\"\"");
+		terms.push_back('"' + word + "\"*"); //NOTE: quoted so FTS5 syntax in the search box is taken literally, `*` so matches show up while the word is being typed
+	}
+	return terms.join(" ");
+}
+
+bool SearchWorker::open(sqlite3_stmt **stmt) {
+	sqlite3 *connection = 0;
+	QString failure_msg;
+	if (sqlite3_open_v2(db_path.toUtf8().constData(), &connection, SQLITE_OPEN_READONLY, 0))
+		failure_msg = "Failed to open the search connection: ";
+	else if (sqlite3_prepare_v2(connection, "SELECT `rowid` FROM `tracks_search` WHERE `tracks_search` MATCH ?", -1, stmt, 0))
+		failure_msg = "Failed to Prepare search query: ";
+	else {
+		QMutexLocker lock(&mutex); //NOTE: search() and stop() interrupt through `db`
+		db = connection;
+		return true;
+	}
+	emit error(failure_msg, sqlite3_errmsg(connection));
+	sqlite3_close(connection);
+	return false;
+}
+
+void SearchWorker::run() {
+	sqlite3_stmt *stmt = 0;
+	forever {
+		QString text;
+		{
+			QMutexLocker lock(&mutex);
+			while (!has_pending && !stopped)
+				wake.wait(&mutex);
+			if (stopped)
+				break;
+			text = pending_text;
+			has_pending = false;
+			querying = true;
+		}
+		if (!stmt && !open(&stmt)) { //NOTE: opened by the first search, and by the next one after it failed to
+			QMutexLocker lock(&mutex);
+			querying = false;
+			continue;
+		}
+		std::string match = matchExpression(text).toStdString(); //NOTE: same conversion as qtos, so it matches the stored text
+		sqlite3_bind_text(stmt, 1, match.c_str(), match.size(), SQLITE_TRANSIENT);
+		QList<int> tids;
+		int return_code;
+		{
+			ProfileSpan span("Failed to Step search: ");
+			while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+				tids.push_back(sqlite3_column_int(stmt, 0));
+				if (tids.count() != limit)
+					continue;
+				QMutexLocker lock(&mutex); //NOTE: the first page goes out while the rest is stepped
+				if (!has_pending && !stopped) {
+					result_text = text;
+					result_tids = tids;
+					has_results = true;
+					emit resultsReady();
+				}
+			}
+			sqlite3_reset(stmt);
+		}
+		QMutexLocker lock(&mutex);
+		querying = false;
+		if (return_code == SQLITE_INTERRUPT || has_pending || stopped) //NOTE: superseded, the next search is already waiting
+			continue;
+		if (return_code != SQLITE_DONE) {
+			emit error("Failed to Step search: ", sqlite3_errmsg(db));
+			continue;
+		}
+		result_text = text;
+		result_tids = tids;
+		has_results = true;
+		emit resultsReady();
+	}
+	sqlite3_finalize(stmt);
+	sqlite3_close(db);
+	db = 0;
+}
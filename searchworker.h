@@ -0,0 +1,53 @@
+#ifndef _SEARCHWORKER_H_
+#define _SEARCHWORKER_H_
+
+#include <QList>
+#include <QMutex>
+#include <QString>
+#include <QThread>
+#include <QWaitCondition>
+
+#include <sqlite3.h>
+
+/*
+ * Runs search box queries against the `tracks_search` full text index on its own read-only connection,
+ * so a slow query never blocks the GUI.  A new search interrupts the one in progress, only the results of
+ * the latest search are handed back through resultsReady().  Matches come back in `tid` order, the first
+ * page of them, up to the given limit, as soon as it has been stepped, and then every match once the search
+ * is done, so the columns fill in milliseconds and the artists and albums they list are never cut short.
+ * A search that fails goes to error() instead, the connection is opened with the first search and, should
+ * that fail, with the next one.
+ */
+class SearchWorker : public QThread
+{
+	Q_OBJECT
+	
+	public:
+		SearchWorker(const QString &, int = 1000, QObject * = 0);
+		~SearchWorker();
+		
+		void search(const QString &);
+		void stop();
+		bool take(QString &, QList<int> &); //NOTE: false when there are no new results
+		static QString matchExpression(const QString &);
+	
+	signals:
+		void resultsReady();
+		void error(const QString &, const QString &);
+	
+	protected:
+		void run();
+	
+	private:
+		bool open(sqlite3_stmt **);
+		
+		QString db_path, pending_text, result_text;
+		QList<int> result_tids;
+		int limit; //NOTE: the matches in a first page
+		bool has_pending, has_results, querying, stopped;
+		sqlite3 *db;
+		QMutex mutex;
+		QWaitCondition wake;
+};
+
+#endif
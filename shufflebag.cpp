@@ -0,0 +1,184 @@
+#include "shufflebag.h"
+#include "profiler.h"
+
+#include <QPair>
+#include <QSet>
+#include <QtAlgorithms>
+
+const qint64 KEY_RANGE = Q_INT64_C(4611686018427387904); //NOTE: 2^62, the trigger in the schema draws keys below this too
+
+/*
+ * Writes a new permutation's keys and starts the pass over, in one transaction.
+ */
+class ReshuffleTask : public DatabaseTask
+{
+	public:
+		ReshuffleTask(const QVector<int> &, const QVector<qint64> &);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QVector<int> tids;
+		QVector<qint64> keys;
+};
+
+ReshuffleTask::ReshuffleTask(const QVector<int> &tids, const QVector<qint64> &keys) : DatabaseTask("Failed to write the shuffle bag: "), tids(tids), keys(keys) {
+}
+
+bool ReshuffleTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "UPDATE `tracks` SET `shuffle_key`=? WHERE `tid`=?", -1, &stmt, 0))
+		return false;
+	if (!exec(db, "BEGIN")) {
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	int return_code = SQLITE_DONE;
+	for (int i = 0; i < tids.count() && return_code == SQLITE_DONE; ++i) {
+		sqlite3_bind_int64(stmt, 1, keys.at(i));
+		sqlite3_bind_int(stmt, 2, tids.at(i));
+		return_code = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_DONE || !exec(db, "UPDATE `shuffle` SET `drawn`=-1")) {
+		exec(db, "ROLLBACK");
+		return false;
+	}
+	return exec(db, "COMMIT");
+}
+
+ShuffleBag::ShuffleBag(DatabaseWorker *database) : database(database), drawn(0) {
+}
+
+bool ShuffleBag::load(sqlite3 *db) {
+	ProfileSpan span("Failed to load the shuffle bag: ");
+	tids.clear();
+	keys.clear();
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `tid`, `shuffle_key` FROM `tracks` ORDER BY `shuffle_key`, `tid`", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		tids.push_back(sqlite3_column_int(stmt, 0));
+		keys.push_back(sqlite3_column_int64(stmt, 1));
+	}
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_DONE)
+		return false;
+	return readDrawn(db);
+}
+
+bool ShuffleBag::loadTracks(sqlite3 *db, const QList<int> &imported) {
+	ProfileSpan span("Failed to load the shuffle bag: ");
+	tids.clear();
+	keys.clear();
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `shuffle_key` FROM `tracks` WHERE `tid`=?", -1, &stmt, 0))
+		return false;
+	QList<QPair<qint64, int> > loaded; //NOTE: key, `tid`, sorted as load() orders them
+	int return_code = SQLITE_DONE;
+	for (int i = 0; i < imported.count() && (return_code == SQLITE_ROW || return_code == SQLITE_DONE); ++i) {
+		sqlite3_bind_int(stmt, 1, imported.at(i));
+		if ((return_code = sqlite3_step(stmt)) == SQLITE_ROW)
+			loaded.push_back(qMakePair(sqlite3_column_int64(stmt, 0), imported.at(i)));
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_ROW && return_code != SQLITE_DONE)
+		return false;
+	qSort(loaded);
+	for (int i = 0; i < loaded.count(); ++i) {
+		tids.push_back(loaded.at(i).second);
+		keys.push_back(loaded.at(i).first);
+	}
+	return readDrawn(db);
+}
+
+void ShuffleBag::restore(const ShuffleBag &saved, const LibraryIndex &library) {
+	if (tids.isEmpty()) { //NOTE: nothing has been drawn or shuffled from an empty bag
+		*this = saved;
+		return;
+	}
+	qint64 drawn_key = drawn > 0 ? keys.at(drawn - 1) : -1;
+	QSet<int> added;
+	for (int i = 0; i < saved.tids.count(); ++i)
+		added.insert(saved.tids.at(i));
+	QVector<int> kept_tids;
+	QVector<qint64> kept_keys;
+	kept_tids.reserve(tids.count());
+	kept_keys.reserve(tids.count());
+	for (int i = 0; i < tids.count(); ++i) { //NOTE: deleted tracks drop out, the rest keep the keys they have in memory
+		added.remove(tids.at(i));
+		if (!library.contains(tids.at(i)))
+			continue;
+		kept_tids.push_back(tids.at(i));
+		kept_keys.push_back(keys.at(i));
+	}
+	tids.clear();
+	keys.clear();
+	int kept = 0;
+	for (int i = 0; i < saved.tids.count(); ++i) { //NOTE: both are sorted by key, imported tracks are merged in at theirs
+		if (!added.contains(saved.tids.at(i)))
+			continue;
+		for (; kept < kept_tids.count() && kept_keys.at(kept) <= saved.keys.at(i); ++kept) {
+			tids.push_back(kept_tids.at(kept));
+			keys.push_back(kept_keys.at(kept));
+		}
+		tids.push_back(saved.tids.at(i));
+		keys.push_back(saved.keys.at(i));
+	}
+	for (; kept < kept_tids.count(); ++kept) {
+		tids.push_back(kept_tids.at(kept));
+		keys.push_back(kept_keys.at(kept));
+	}
+	drawn = qUpperBound(keys.begin(), keys.end(), drawn_key) - keys.begin();
+}
+
+bool ShuffleBag::readDrawn(sqlite3 *db) {
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `drawn` FROM `shuffle`", -1, &stmt, 0))
+		return false;
+	qint64 drawn_key = -1;
+	int return_code;
+	if ((return_code = sqlite3_step(stmt)) == SQLITE_ROW)
+		drawn_key = sqlite3_column_int64(stmt, 0);
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_ROW && return_code != SQLITE_DONE)
+		return false;
+	drawn = qUpperBound(keys.begin(), keys.end(), drawn_key) - keys.begin();
+	return true;
+}
+
+int ShuffleBag::next() {
+	if (tids.isEmpty())
+		return 0;
+	if (drawn >= tids.count())
+		reshuffle();
+	if (database)
+		database->post(new ExecTask(sqlite3_mprintf("UPDATE `shuffle` SET `drawn`=%lld", keys.at(drawn)), "Failed to draw from the shuffle bag: "));
+	return tids.at(drawn++);
+}
+
+int ShuffleBag::peek(int ahead) {
+	if (tids.isEmpty())
+		return 0;
+	if (ahead == 0 && drawn >= tids.count()) //NOTE: the next pass only exists once it has been shuffled
+		reshuffle();
+	return drawn + ahead < tids.count() ? tids.at(drawn + ahead) : 0;
+}
+
+void ShuffleBag::reshuffle() {
+	int last = tids.last();
+	for (int i = tids.count() - 1; i > 0; --i) //NOTE: Fisher-Yates
+		qSwap(tids[i], tids[qrand() % (i + 1)]);
+	if (tids.count() > 1 && tids.first() == last) //NOTE: the track that ended the last pass doesn't start the next one
+		qSwap(tids.first(), tids.last());
+	qint64 step = KEY_RANGE / tids.count(); //NOTE: evenly spaced keys leave room for imported tracks anywhere in the pass
+	for (int i = 0; i < tids.count(); ++i)
+		keys[i] = i * step;
+	drawn = 0;
+	if (database)
+		database->post(new ReshuffleTask(tids, keys));
+}
@@ -0,0 +1,43 @@
+#ifndef _SHUFFLEBAG_H_
+#define _SHUFFLEBAG_H_
+
+#include <QList>
+#include <QVector>
+
+#include <sqlite3.h>
+
+#include "databaseworker.h"
+#include "libraryindex.h"
+
+/*
+ * Shuffle without repeats: every track has a `shuffle_key` and the bag is the library sorted by that key.
+ * One pass plays the bag from front to back, `shuffle`.`drawn` holds the key of the last track drawn, so
+ * the pass carries on where it left off after a restart.  Imported tracks are given a key after `drawn` by
+ * a trigger, deleted tracks simply drop out of the bag, and a new permutation is written when a pass ends.
+ * The bag is loaded on the DatabaseWorker thread, draws are made in memory and written behind through it
+ * (a bag without a worker, as in the benchmarks, is not written back).  A reload only brings in which tracks
+ * there are, the order and the draws of the bag in memory are newer than what the database held when it ran,
+ * so a reload after an import reads the keys of the imported tracks alone.
+ */
+class ShuffleBag
+{
+	public:
+		ShuffleBag(DatabaseWorker * = 0);
+		
+		bool load(sqlite3 *);
+		bool loadTracks(sqlite3 *, const QList<int> &); //NOTE: only these tracks, the ones imported since the bag in memory was loaded
+		void restore(const ShuffleBag &, const LibraryIndex &); //NOTE: takes over a loaded bag, keeping what was drawn and shuffled while it loaded
+		int next(); //NOTE: the `tid` of the next track, 0 when the library is empty
+		int peek(int); //NOTE: the `tid` that many draws ahead without drawing it, 0 past the end of the pass
+	
+	private:
+		bool readDrawn(sqlite3 *);
+		void reshuffle();
+		
+		DatabaseWorker *database;
+		QVector<int> tids;
+		QVector<qint64> keys;
+		int drawn;
+};
+
+#endif
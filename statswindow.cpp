@@ -0,0 +1,165 @@
+#include "statswindow.h"
+#include "profiler.h"
+
+#include <QGridLayout>
+#include <QHBoxLayout>
+#include <QStringList>
+
+#include <KIcon>
+
+const int TOP_PAGE_SIZE = 10;
+
+/*
+ * Reads the `library_stats` row.
+ */
+class SummaryTask : public DatabaseTask
+{
+	public:
+		SummaryTask();
+		
+		bool run(sqlite3 *);
+		
+		int artists, albums, tracks;
+		qint64 length;
+};
+
+/*
+ * Reads one page of top tracks, plus one more row to tell whether there is a next page.
+ */
+class TopPageTask : public DatabaseTask
+{
+	public:
+		TopPageTask(int, const StatsWindow::TopKey &);
+		
+		bool run(sqlite3 *);
+		
+		int page;
+		StatsWindow::TopKey after, last; //NOTE: `after` is the last track shown on the page before
+		QStringList texts;
+		bool more;
+};
+
+SummaryTask::SummaryTask() : DatabaseTask("Failed to Step statistics: "), artists(0), albums(0), tracks(0), length(0) {
+}
+
+bool SummaryTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `artists`, `albums`, `tracks`, `length` FROM `library_stats`", -1, &stmt, 0))
+		return false;
+	int return_code = sqlite3_step(stmt);
+	if (return_code == SQLITE_ROW) {
+		artists = sqlite3_column_int(stmt, 0);
+		albums = sqlite3_column_int(stmt, 1);
+		tracks = sqlite3_column_int(stmt, 2);
+		length = sqlite3_column_int64(stmt, 3);
+	}
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_ROW;
+}
+
+TopPageTask::TopPageTask(int page, const StatsWindow::TopKey &after) : DatabaseTask("Failed to Step top tracks: "), page(page), after(after), more(false) {
+}
+
+bool TopPageTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	const char *first_query = "SELECT `playcount`, `tid`, `name`, `title` FROM `tracks` JOIN `artists` ON `artist_id`=`aid` "
+	                          "WHERE `playcount`>0 ORDER BY `playcount` DESC, `tid` DESC LIMIT ?3";
+	const char *after_query = "SELECT `playcount`, `tid`, `name`, `title` FROM `tracks` JOIN `artists` ON `artist_id`=`aid` "
+	                          "WHERE `playcount`>0 AND `playcount`<=?1 AND (`playcount`<?1 OR `tid`<?2) ORDER BY `playcount` DESC, `tid` DESC LIMIT ?3"; //NOTE: `playcount`<=?1 is the index range, the OR only filters out the tracks tied with the last one shown
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, page == 0 ? first_query : after_query, -1, &stmt, 0))
+		return false;
+	if (page > 0) {
+		sqlite3_bind_int(stmt, 1, after.first);
+		sqlite3_bind_int(stmt, 2, after.second);
+	}
+	sqlite3_bind_int(stmt, 3, TOP_PAGE_SIZE + 1); //NOTE: one more than is shown tells whether there is a next page
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW && texts.count() < TOP_PAGE_SIZE) {
+		last = StatsWindow::TopKey(sqlite3_column_int(stmt, 0), sqlite3_column_int(stmt, 1));
+		texts.push_back(QString("%1. %2 - %3 (%4)").arg(page * TOP_PAGE_SIZE + texts.count() + 1).arg((const char *)sqlite3_column_text(stmt, 2)).arg((const char *)sqlite3_column_text(stmt, 3)).arg(last.first));
+	}
+	more = return_code == SQLITE_ROW;
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_ROW || return_code == SQLITE_DONE;
+}
+
+StatsWindow::StatsWindow(DatabaseWorker *database, QWidget *parent) : QWidget(parent, Qt::Dialog), database(database), page(0) {
+	setWindowModality(Qt::WindowModal);
+	setWindowTitle("Database Statistics  |  Projekt 7");
+	ok_button = new KPushButton(KIcon("dialog-ok-apply"), "OK", this);
+	ok_button->setSizePolicy(QSizePolicy::Maximum, QSizePolicy::Fixed);
+	previous_button = new KPushButton(KIcon("go-previous"), "", this);
+	next_button = new KPushButton(KIcon("go-next"), "", this);
+	top_tracks = new KListWidget(this);
+	
+	QHBoxLayout *page_buttons_layout = new QHBoxLayout;
+	page_buttons_layout->addWidget(previous_button);
+	page_buttons_layout->addWidget(next_button);
+	QWidget *page_buttons = new QWidget(this);
+	page_buttons->setLayout(page_buttons_layout);
+	
+	QGridLayout *swLayout = new QGridLayout;
+	swLayout->addWidget(new QLabel("Artists:",         this), 0, 0);
+	swLayout->addWidget(new QLabel("Albums:",          this), 1, 0);
+	swLayout->addWidget(new QLabel("Tracks:",          this), 2, 0);
+	swLayout->addWidget(new QLabel("Total Play Time:", this), 3, 0);
+	swLayout->addWidget(num_artists  = new QLabel(this), 0, 1);
+	swLayout->addWidget(num_albums   = new QLabel(this), 1, 1);
+	swLayout->addWidget(num_tracks   = new QLabel(this), 2, 1);
+	swLayout->addWidget(total_length = new QLabel(this), 3, 1);
+	swLayout->addWidget(new QLabel("Top Tracks:",      this), 4, 0, 1, 2);
+	swLayout->addWidget(top_tracks, 5, 0, 1, 2);
+	swLayout->addWidget(page_buttons, 6, 0, 1, 2, Qt::AlignCenter);
+	swLayout->addWidget(ok_button, 7, 0, 1, 2, Qt::AlignCenter);
+	setLayout(swLayout);
+	
+	connect(previous_button, SIGNAL(clicked()), this, SLOT(previousPage()));
+	connect(next_button,     SIGNAL(clicked()), this, SLOT(nextPage()));
+	connect(ok_button,       SIGNAL(clicked()), this, SLOT(hide()));
+}
+
+void StatsWindow::refresh() {
+	database->post(new SummaryTask, this, "summaryRead");
+	page_ends.clear();
+	page = 0;
+	readPage(0);
+}
+
+void StatsWindow::previousPage() {
+	if (page > 0)
+		readPage(page - 1);
+}
+
+void StatsWindow::nextPage() {
+	readPage(page + 1);
+}
+
+void StatsWindow::summaryRead(DatabaseTask *task) {
+	SummaryTask *summary = static_cast<SummaryTask *>(task);
+	num_artists->setText(QString::number(summary->artists));
+	num_albums->setText(QString::number(summary->albums));
+	num_tracks->setText(QString::number(summary->tracks));
+	qint64 length = summary->length;
+	total_length->setText(QString("%1:%2:%3").arg(length / 3600).arg(length / 60 % 60, 2, 10, QChar('0')).arg(length % 60, 2, 10, QChar('0')));
+}
+
+void StatsWindow::readPage(int new_page) {
+	if (new_page > page_ends.count()) //NOTE: the page before hasn't come back yet
+		return;
+	database->post(new TopPageTask(new_page, new_page > 0 ? page_ends.at(new_page - 1) : TopKey()), this, "pageRead");
+}
+
+void StatsWindow::pageRead(DatabaseTask *task) {
+	TopPageTask *top = static_cast<TopPageTask *>(task);
+	if (top->page > page_ends.count()) //NOTE: refreshed since, the page it follows is gone
+		return;
+	page = top->page;
+	page_ends.resize(page + 1);
+	page_ends[page] = top->last;
+	top_tracks->clear();
+	top_tracks->addItems(top->texts);
+	previous_button->setEnabled(page > 0);
+	next_button->setEnabled(top->more);
+}
@@ -0,0 +1,51 @@
+#ifndef _STATSWINDOW_H_
+#define _STATSWINDOW_H_
+
+#include <QLabel>
+#include <QPair>
+#include <QVector>
+#include <QWidget>
+
+#include <KListWidget>
+#include <KPushButton>
+
+#include <sqlite3.h>
+
+#include "databaseworker.h"
+
+/*
+ * Database statistics: the counts and total play time are read from the single `library_stats` row that
+ * triggers keep current, and the top tracks are paged ten at a time down the `tracks_playcount` index.
+ * Pages are found by the (`playcount`, `tid`) of the last track on the page before, not by OFFSET, so
+ * flipping to the 50th page costs the same as flipping to the 2nd.  Both are read on the DatabaseWorker thread
+ * and shown when they arrive.
+ */
+class StatsWindow : public QWidget
+{
+	Q_OBJECT
+	
+	public:
+		typedef QPair<int, int> TopKey; //NOTE: (`playcount`, `tid`)
+		
+		StatsWindow(DatabaseWorker *, QWidget *parent = 0);
+		
+		void refresh();
+	
+	private slots:
+		void previousPage();
+		void nextPage();
+		void summaryRead(DatabaseTask *);
+		void pageRead(DatabaseTask *);
+	
+	private:
+		void readPage(int);
+		
+		DatabaseWorker *database;
+		QLabel *num_artists, *num_albums, *num_tracks, *total_length;
+		KListWidget *top_tracks;
+		KPushButton *previous_button, *next_button, *ok_button;
+		QVector<TopKey> page_ends; //NOTE: the key of the last track on each page that has been shown
+		int page;
+};
+
+#endif
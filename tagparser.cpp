@@ -0,0 +1,519 @@
+#include "tagparser.h"
+
+#include <QHash>
+#include <QList>
+#include <QStringList>
+
+#include <taglib/audioproperties.h>
+#include <taglib/tag.h>
+#include <taglib/fileref.h>
+
+#define ttoq(t) QString::fromUtf8((t).toCString(true))
+
+const qint64 HEAD_SIZE = 4096; //NOTE: an ID3v2 tag without cover art and the first MPEG frame, or the FLAC and Ogg headers, usually fit
+const qint64 TAIL_SIZE = 8192; //NOTE: holds the last Ogg page, which is rarely longer than a few KB
+const qint64 FRAME_SEARCH = 2048; //NOTE: how far past the ID3v2 tag the first MPEG frame is looked for
+const qint64 MAX_TAG_SIZE = 1 << 20; //NOTE: a larger text frame, Vorbis comment or MP4 item is left to TagLib
+
+static const int MPEG_BITRATES[2][3][16] = { //NOTE: kbps by MPEG-1 or 2/2.5, layer and index, 0 is free format and 15 is invalid
+	{{0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448, 0},
+	 {0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384, 0},
+	 {0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 0}},
+	{{0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256, 0},
+	 {0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0},
+	 {0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160, 0}}
+};
+static const int MPEG_SAMPLE_RATES[3][3] = {{44100, 48000, 32000}, {22050, 24000, 16000}, {11025, 12000, 8000}}; //NOTE: MPEG-1, 2, 2.5
+
+static quint32 bigEndian(const char *data, int bytes) {
+	quint32 value = 0;
+	for (int i = 0; i < bytes; ++i)
+		value = (value << 8) | (uchar)data[i];
+	return value;
+}
+
+static quint64 littleEndian(const char *data, int bytes) {
+	quint64 value = 0;
+	for (int i = bytes - 1; i >= 0; --i)
+		value = (value << 8) | (uchar)data[i];
+	return value;
+}
+
+static quint32 syncsafe(const char *data) {
+	return (data[0] & 0x7F) << 21 | (data[1] & 0x7F) << 14 | (data[2] & 0x7F) << 7 | (data[3] & 0x7F);
+}
+
+static int leadingInt(const QString &text) { //NOTE: what TagLib's String::toInt() reads, "3/12" is 3 and "2004-05-01" is 2004
+	int i = 0, value = 0;
+	bool negative = !text.isEmpty() && text.at(0) == '-';
+	if (negative || (!text.isEmpty() && text.at(0) == '+'))
+		++i;
+	for (; i < text.length() && text.at(i) >= '0' && text.at(i) <= '9'; ++i)
+		value = value * 10 + text.at(i).digitValue();
+	return negative ? -value : value;
+}
+
+static QString latin1Field(const QByteArray &data, int offset, int length) { //NOTE: ID3v1, cut at the first null and trimmed like TagLib does
+	QByteArray field = data.mid(offset, length);
+	int null = field.indexOf('\0');
+	return QString::fromLatin1(field.constData(), null == -1 ? field.size() : null).trimmed();
+}
+
+static bool decodeText(const QByteArray &data, int encoding, QString &text) {
+	if (encoding == 0)
+		text = QString::fromLatin1(data.constData(), data.size());
+	else if (encoding == 3)
+		text = QString::fromUtf8(data.constData(), data.size());
+	else {
+		text.clear();
+		if (data.isEmpty())
+			return true;
+		bool big_endian = encoding == 2;
+		int start = 0;
+		if (encoding == 1) {
+			if (data.size() < 2 || (!((uchar)data.at(0) == 0xFE && (uchar)data.at(1) == 0xFF) && !((uchar)data.at(0) == 0xFF && (uchar)data.at(1) == 0xFE)))
+				return false; //NOTE: UTF-16 without a byte order mark, TagLib guesses
+			big_endian = (uchar)data.at(0) == 0xFE;
+			start = 2;
+		}
+		text.reserve((data.size() - start) / 2);
+		for (int i = start; i + 1 < data.size(); i += 2) {
+			ushort high = (uchar)data.at(big_endian ? i : i + 1), low = (uchar)data.at(big_endian ? i + 1 : i);
+			text.append(QChar(high << 8 | low));
+		}
+	}
+	return true;
+}
+
+static bool readTextFrame(const QByteArray &frame, QString &text) { //NOTE: the values of a frame are joined with spaces, as TagLib's toString() does
+	text.clear();
+	if (frame.isEmpty())
+		return true;
+	int encoding = frame.at(0);
+	if (encoding < 0 || encoding > 3)
+		return false;
+	int width = encoding == 1 || encoding == 2 ? 2 : 1;
+	QStringList values;
+	int start = 1;
+	while (start < frame.size()) {
+		int end = start;
+		while (end + width <= frame.size() && !(frame.at(end) == 0 && (width == 1 || frame.at(end + 1) == 0)))
+			end += width;
+		if (end + width > frame.size())
+			end = frame.size();
+		QString value;
+		if (!decodeText(frame.mid(start, end - start), encoding, value))
+			return false;
+		if (!value.isEmpty())
+			values.push_back(value);
+		start = end + width;
+	}
+	text = values.join(" ");
+	return true;
+}
+
+TagParser::TagParser(const QString &path) : file(path), size(0) {
+}
+
+bool TagParser::read(TrackInfo &track) {
+	QString extension = file.fileName().section('.', -1).toLower();
+	bool (TagParser::*reader)(TrackInfo &) = 0;
+	if (extension == "mp3")
+		reader = &TagParser::readMpeg;
+	else if (extension == "flac")
+		reader = &TagParser::readFlac;
+	else if (extension == "ogg" || extension == "oga")
+		reader = &TagParser::readOgg;
+	else if (extension == "m4a" || extension == "m4b" || extension == "mp4")
+		reader = &TagParser::readMp4;
+	if (!reader || !file.open(QIODevice::ReadOnly | QIODevice::Unbuffered)) //NOTE: unbuffered, QFile would read ahead further than the tags
+		return false;
+	size = file.size();
+	head = file.read(HEAD_SIZE);
+	track.artist.clear();
+	track.album.clear();
+	track.title.clear();
+	track.year = 0;
+	track.track_number = 0;
+	track.length = 0;
+	return (this->*reader)(track);
+}
+
+bool TagParser::readTagLib(const QString &path, TrackInfo &track) {
+	TagLib::FileRef f(path.toUtf8().constData()); //NOTE: don't ask me why TabLib won't accept qtos(path), but this seems to work for international characters
+	if (f.isNull() || !f.tag()) //NOTE: not something TagLib can read (cover art, playlists, ...)
+		return false;
+	track.artist = ttoq(f.tag()->artist());
+	track.year = f.tag()->year();
+	track.album = ttoq(f.tag()->album());
+	track.track_number = f.tag()->track();
+	track.title = ttoq(f.tag()->title());
+	track.length = f.audioProperties() ? f.audioProperties()->length() : 0; //NOTE: FileRef has already read the audio properties
+	return true;
+}
+
+bool TagParser::readMpeg(TrackInfo &track) {
+	qint64 audio_start = 0;
+	if (head.startsWith("ID3")) {
+		if (head.size() < 10 || !readId3v2(head.left(10), track))
+			return false;
+		audio_start = 10 + syncsafe(head.constData() + 6) + (head.at(5) & 0x10 ? 10 : 0); //NOTE: an ID3v2.4 footer follows the frames
+	}
+	QByteArray tail = readAt(qMax(size - 160, audio_start), size - qMax(size - 160, audio_start));
+	if (tail.contains("APETAGEX") || tail.contains("LYRICS200")) //NOTE: APE and Lyrics3 tags, TagLib merges the APE one in
+		return false;
+	qint64 audio_end = size;
+	if (tail.size() >= 128 && tail.mid(tail.size() - 128, 3) == "TAG") {
+		readId3v1(tail.right(128), track);
+		audio_end -= 128;
+	}
+	QByteArray frames = readAt(audio_start, FRAME_SEARCH);
+	const char *data = frames.constData();
+	for (int i = 0; i + 4 <= frames.size(); ++i) {
+		if ((uchar)data[i] != 0xFF || ((uchar)data[i + 1] & 0xE0) != 0xE0)
+			continue;
+		int version = (data[i + 1] >> 3) & 3, layer = (data[i + 1] >> 1) & 3; //NOTE: version 3 is MPEG-1, 2 MPEG-2, 0 MPEG-2.5, layer 3 is I and 1 is III
+		int bitrate_index = ((uchar)data[i + 2] >> 4) & 15, rate_index = (data[i + 2] >> 2) & 3;
+		if (version == 1 || layer == 0 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3)
+			continue;
+		bool mpeg1 = version == 3, mono = (((uchar)data[i + 3] >> 6) & 3) == 3;
+		int bitrate = MPEG_BITRATES[mpeg1 ? 0 : 1][3 - layer][bitrate_index];
+		int sample_rate = MPEG_SAMPLE_RATES[mpeg1 ? 0 : version == 2 ? 1 : 2][rate_index];
+		int samples_per_frame = layer == 3 ? 384 : layer == 1 && !mpeg1 ? 576 : 1152;
+		int frame_length = samples_per_frame / 8 * bitrate * 1000 / sample_rate + ((data[i + 2] >> 1) & 1) * (layer == 3 ? 4 : 1);
+		if (i + frame_length + 1 < frames.size() && ((uchar)data[i + frame_length] != 0xFF || ((uchar)data[i + frame_length + 1] & 0xE0) != 0xE0))
+			continue; //NOTE: no frame where the next one should be, this was junk that looked like a sync word
+		qint64 num_frames = 0;
+		int xing = i + 4 + (layer != 1 ? 0 : mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17)); //NOTE: after the side information of the first frame
+		int vbri = i + 4 + 32;
+		if (layer == 1 && xing + 12 <= frames.size() && (frames.mid(xing, 4) == "Xing" || frames.mid(xing, 4) == "Info") && (bigEndian(data + xing + 4, 4) & 1))
+			num_frames = bigEndian(data + xing + 8, 4);
+		else if (layer == 1 && vbri + 18 <= frames.size() && frames.mid(vbri, 4) == "VBRI")
+			num_frames = bigEndian(data + vbri + 14, 4);
+		if (num_frames > 0)
+			track.length = num_frames * samples_per_frame / sample_rate;
+		else
+			track.length = int((audio_end - audio_start - i) * 8.0 / bitrate + 0.5) / 1000; //NOTE: constant bitrate, in milliseconds first like TagLib
+		return true;
+	}
+	return false; //NOTE: no frame near the start, TagLib looks further
+}
+
+bool TagParser::readFlac(TrackInfo &track) {
+	if (!head.startsWith("fLaC")) //NOTE: an ID3v2 tag in front of the stream, TagLib reads that one as well
+		return false;
+	qint64 offset = 4;
+	bool last = false, has_info = false, has_comment = false;
+	while (!last && !(has_info && has_comment)) {
+		QByteArray header = readAt(offset, 4);
+		if (header.size() < 4)
+			return false;
+		last = header.at(0) & 0x80;
+		int type = header.at(0) & 0x7F;
+		qint64 length = bigEndian(header.constData() + 1, 3);
+		if (type == 0 || (type == 4 && !has_comment)) { //NOTE: STREAMINFO and VORBIS_COMMENT, the pictures and padding are never read
+			QByteArray block = readAt(offset + 4, length);
+			if (block.size() < length)
+				return false;
+			if (type == 0) {
+				if (length < 18)
+					return false;
+				const char *info = block.constData();
+				quint32 sample_rate = bigEndian(info + 10, 3) >> 4;
+				quint64 samples = (quint64)(info[13] & 0x0F) << 32 | bigEndian(info + 14, 4);
+				if (!sample_rate)
+					return false;
+				track.length = samples / sample_rate;
+				has_info = true;
+			}
+			else {
+				if (!readVorbisComment(block, track))
+					return false;
+				has_comment = true;
+			}
+		}
+		offset += 4 + length;
+	}
+	if (!has_info)
+		return false;
+	if (track.artist.isEmpty() || track.album.isEmpty() || track.title.isEmpty() || !track.year || !track.track_number) {
+		QByteArray tail = readAt(size - 128, 128); //NOTE: TagLib fills what the comment lacks from an ID3v1 tag
+		if (tail.size() == 128 && tail.startsWith("TAG"))
+			readId3v1(tail, track);
+	}
+	return true;
+}
+
+bool TagParser::readOgg(TrackInfo &track) {
+	QList<QByteArray> packets;
+	QByteArray packet;
+	quint32 serial = 0;
+	qint64 offset = 0;
+	while (packets.count() < 2) { //NOTE: the identification and comment headers, which may span pages
+		QByteArray page = readAt(offset, 27);
+		if (page.size() < 27 || !page.startsWith("OggS") || page.at(4) != 0)
+			return false;
+		quint32 page_serial = littleEndian(page.constData() + 14, 4);
+		if (offset == 0)
+			serial = page_serial;
+		else if (page_serial != serial) //NOTE: multiplexed streams are TagLib's
+			return false;
+		int num_segments = (uchar)page.at(26);
+		QByteArray segments = readAt(offset + 27, num_segments);
+		if (segments.size() < num_segments)
+			return false;
+		qint64 body_size = 0;
+		for (int i = 0; i < num_segments; ++i)
+			body_size += (uchar)segments.at(i);
+		QByteArray body = readAt(offset + 27 + num_segments, body_size);
+		if (body.size() < body_size)
+			return false;
+		int position = 0;
+		for (int i = 0; i < num_segments && packets.count() < 2; ++i) {
+			int length = (uchar)segments.at(i);
+			packet += body.mid(position, length);
+			position += length;
+			if (length < 255) {
+				packets.push_back(packet);
+				packet.clear();
+			}
+		}
+		if (packet.size() > MAX_TAG_SIZE)
+			return false;
+		offset += 27 + num_segments + body_size;
+	}
+	const QByteArray &info = packets.at(0), &comment = packets.at(1);
+	if (info.size() < 16 || !info.startsWith("\x01vorbis") || !comment.startsWith("\x03vorbis")) //NOTE: Opus, Speex and FLAC in Ogg are TagLib's
+		return false;
+	quint32 sample_rate = littleEndian(info.constData() + 12, 4);
+	if (!sample_rate || !readVorbisComment(comment.mid(7), track))
+		return false;
+	qint64 tail_size = qMin(size, TAIL_SIZE);
+	QByteArray tail = readAt(size - tail_size, tail_size);
+	int last = tail.lastIndexOf("OggS");
+	while (last != -1 && (last + 27 > tail.size() || littleEndian(tail.constData() + last + 14, 4) != serial))
+		last = last > 0 ? tail.lastIndexOf("OggS", last - 1) : -1;
+	if (last == -1)
+		return false;
+	qint64 granule = littleEndian(tail.constData() + last + 6, 8); //NOTE: the samples decoded by the end of the last page
+	if (granule < 0)
+		return false;
+	track.length = granule / sample_rate;
+	return true;
+}
+
+bool TagParser::readMp4(TrackInfo &track) {
+	qint64 moov, moov_end;
+	if (!findAtom(0, size, "moov", moov, moov_end))
+		return false;
+	QByteArray type;
+	qint64 body, next;
+	bool has_length = false;
+	for (qint64 offset = moov; offset < moov_end && !has_length; offset = next) { //NOTE: the length of the first sound track, as TagLib reads it
+		if (!readAtom(offset, moov_end, type, body, next))
+			return false;
+		qint64 mdia, mdia_end, hdlr, hdlr_end, mdhd, mdhd_end;
+		if (type != "trak" || !findAtom(body, next, "mdia", mdia, mdia_end) || !findAtom(mdia, mdia_end, "hdlr", hdlr, hdlr_end) || readAt(hdlr + 8, 4) != "soun")
+			continue;
+		if (!findAtom(mdia, mdia_end, "mdhd", mdhd, mdhd_end))
+			return false;
+		QByteArray header = readAt(mdhd, 32);
+		if (header.size() < 20 || (header.at(0) == 1 && header.size() < 32))
+			return false;
+		const char *data = header.constData();
+		quint32 timescale = header.at(0) == 1 ? bigEndian(data + 20, 4) : bigEndian(data + 12, 4);
+		quint64 duration = header.at(0) == 1 ? (quint64)bigEndian(data + 24, 4) << 32 | bigEndian(data + 28, 4) : bigEndian(data + 16, 4);
+		if (!timescale)
+			return false;
+		track.length = duration / timescale;
+		has_length = true;
+	}
+	if (!has_length)
+		return false;
+	qint64 udta, udta_end, meta, meta_end, ilst, ilst_end;
+	if (!findAtom(moov, moov_end, "udta", udta, udta_end) || !findAtom(udta, udta_end, "meta", meta, meta_end) || !findAtom(meta + 4, meta_end, "ilst", ilst, ilst_end))
+		return true; //NOTE: no tags, `meta` has a version and flags before its atoms
+	for (qint64 offset = ilst; offset < ilst_end; offset = next) {
+		if (!readAtom(offset, ilst_end, type, body, next))
+			return false;
+		if (type != "\251ART" && type != "\251alb" && type != "\251nam" && type != "\251day" && type != "trkn") //NOTE: the cover art is never read
+			continue;
+		if (next - body > MAX_TAG_SIZE)
+			return false;
+		QByteArray item = readAt(body, next - body);
+		QStringList values;
+		int track_number = 0;
+		for (int position = 0; position + 16 <= item.size(); ) { //NOTE: `data` atoms: size, "data", type, locale, value
+			int length = bigEndian(item.constData() + position, 4);
+			if (length < 16 || position + length > item.size())
+				return false;
+			if (item.mid(position + 4, 4) == "data") {
+				QByteArray value = item.mid(position + 16, length - 16);
+				if (type == "trkn" && value.size() >= 4)
+					track_number = (short)bigEndian(value.constData() + 2, 2);
+				else if (type != "trkn")
+					values.push_back(QString::fromUtf8(value.constData(), value.size()));
+			}
+			position += length;
+		}
+		if (type == "\251ART")
+			track.artist = values.join(", ");
+		else if (type == "\251alb")
+			track.album = values.join(", ");
+		else if (type == "\251nam")
+			track.title = values.join(", ");
+		else if (type == "\251day")
+			track.year = leadingInt(values.join(" "));
+		else
+			track.track_number = track_number;
+	}
+	return true;
+}
+
+//NOTE: walks the frame headers and reads only the text frames it wants, cover art and lyrics are seeked over
+bool TagParser::readId3v2(const QByteArray &tag_header, TrackInfo &track) {
+	int major = tag_header.at(3);
+	if (major < 2 || major > 4 || (tag_header.at(5) & 0xC0)) //NOTE: unsynchronisation, and an extended header or compression, TagLib undoes those
+		return false;
+	int header_size = major == 2 ? 6 : 10, id_size = major == 2 ? 3 : 4;
+	qint64 end = 10 + syncsafe(tag_header.constData() + 6);
+	QHash<QByteArray, QString> frames; //NOTE: the first frame of each, TagLib reads the first one too
+	for (qint64 offset = 10; offset + header_size <= end; ) {
+		QByteArray header = readAt(offset, header_size);
+		const char *data = header.constData();
+		if (header.size() < header_size || data[0] == 0) //NOTE: a null where an ID should be starts the padding
+			break;
+		QByteArray id = header.left(id_size);
+		quint32 frame_size;
+		if (major == 4) {
+			if ((data[4] | data[5] | data[6] | data[7]) & 0x80)
+				return false; //NOTE: not syncsafe, as iTunes wrote them, TagLib guesses what was meant
+			if (data[9] & 0x4F)
+				return false; //NOTE: grouped, compressed, encrypted, unsynchronised or with a data length indicator
+			frame_size = syncsafe(data + 4);
+		}
+		else if (major == 3) {
+			if (data[9] & 0xE0)
+				return false; //NOTE: compressed, encrypted or grouped
+			frame_size = bigEndian(data + 4, 4);
+		}
+		else
+			frame_size = bigEndian(data + 3, 3);
+		if (frame_size > end - offset - header_size) //NOTE: TagLib stops at a frame that runs past the tag as well
+			break;
+		if (id == "TP1")
+			id = "TPE1";
+		else if (id == "TAL")
+			id = "TALB";
+		else if (id == "TT2")
+			id = "TIT2";
+		else if (id == "TRK")
+			id = "TRCK";
+		else if (id == "TYE" || id == "TYER") //NOTE: TagLib reads an ID3v2.3 year as an ID3v2.4 recording time
+			id = "TDRC";
+		if ((id == "TPE1" || id == "TALB" || id == "TIT2" || id == "TRCK" || id == "TDRC") && !frames.contains(id)) {
+			QString text;
+			if (frame_size > MAX_TAG_SIZE || !readTextFrame(readAt(offset + header_size, frame_size), text))
+				return false;
+			frames.insert(id, text);
+		}
+		offset += header_size + frame_size;
+	}
+	track.artist = frames.value("TPE1");
+	track.album = frames.value("TALB");
+	track.title = frames.value("TIT2");
+	track.year = leadingInt(frames.value("TDRC").left(4));
+	track.track_number = leadingInt(frames.value("TRCK"));
+	return true;
+}
+
+void TagParser::readId3v1(const QByteArray &tag, TrackInfo &track) { //NOTE: only fills what is still empty, as TagLib's union of tags does
+	if (track.title.isEmpty())
+		track.title = latin1Field(tag, 3, 30);
+	if (track.artist.isEmpty())
+		track.artist = latin1Field(tag, 33, 30);
+	if (track.album.isEmpty())
+		track.album = latin1Field(tag, 63, 30);
+	if (!track.year)
+		track.year = leadingInt(latin1Field(tag, 93, 4));
+	if (!track.track_number && tag.at(125) == 0 && tag.at(126) != 0) //NOTE: ID3v1.1 keeps the track number in the last byte of the comment
+		track.track_number = (uchar)tag.at(126);
+}
+
+bool TagParser::readVorbisComment(const QByteArray &block, TrackInfo &track) {
+	const char *data = block.constData();
+	qint64 length = block.size();
+	if (length < 8)
+		return false;
+	qint64 offset = 4 + littleEndian(data, 4); //NOTE: past the vendor string
+	if (offset + 4 > length)
+		return false;
+	quint32 count = littleEndian(data + offset, 4);
+	offset += 4;
+	QHash<QString, QStringList> fields;
+	for (quint32 i = 0; i < count; ++i) {
+		if (offset + 4 > length)
+			return false;
+		qint64 field_length = littleEndian(data + offset, 4);
+		offset += 4;
+		if (field_length > length - offset)
+			return false;
+		QString field = QString::fromUtf8(data + offset, field_length);
+		offset += field_length;
+		int equals = field.indexOf('=');
+		if (equals > 0)
+			fields[field.left(equals).toUpper()].push_back(field.mid(equals + 1));
+	}
+	track.artist = fields.value("ARTIST").join(" ");
+	track.album = fields.value("ALBUM").join(" ");
+	track.title = fields.value("TITLE").join(" ");
+	QStringList year = fields.contains("DATE") ? fields.value("DATE") : fields.value("YEAR");
+	QStringList track_number = fields.contains("TRACKNUMBER") ? fields.value("TRACKNUMBER") : fields.value("TRACKNUM");
+	track.year = year.isEmpty() ? 0 : leadingInt(year.first());
+	track.track_number = track_number.isEmpty() ? 0 : leadingInt(track_number.first());
+	return true;
+}
+
+//NOTE: reads the header of the atom at `offset`, `body` is where its contents start and `next` where the atom after it does
+bool TagParser::readAtom(qint64 offset, qint64 end, QByteArray &type, qint64 &body, qint64 &next) {
+	QByteArray header = readAt(offset, 16);
+	if (header.size() < 8)
+		return false;
+	qint64 atom_size = bigEndian(header.constData(), 4);
+	type = header.mid(4, 4);
+	body = offset + 8;
+	if (atom_size == 1) { //NOTE: a 64 bit size follows the type
+		if (header.size() < 16)
+			return false;
+		atom_size = (qint64)bigEndian(header.constData() + 8, 4) << 32 | bigEndian(header.constData() + 12, 4);
+		body += 8;
+	}
+	else if (atom_size == 0) //NOTE: runs to the end of the file
+		atom_size = end - offset;
+	next = offset + atom_size;
+	return atom_size >= body - offset && next <= end;
+}
+
+bool TagParser::findAtom(qint64 start, qint64 end, const char *type, qint64 &body, qint64 &atom_end) {
+	QByteArray atom_type;
+	qint64 next;
+	for (qint64 offset = start; offset < end; offset = next) {
+		if (!readAtom(offset, end, atom_type, body, next))
+			return false;
+		if (atom_type == type) {
+			atom_end = next;
+			return true;
+		}
+	}
+	return false;
+}
+
+QByteArray TagParser::readAt(qint64 offset, qint64 length) {
+	if (offset < 0 || length <= 0)
+		return QByteArray();
+	if (offset + length <= head.size())
+		return head.mid(offset, length);
+	if (!file.seek(offset))
+		return QByteArray();
+	return file.read(length);
+}
@@ -0,0 +1,42 @@
+#ifndef _TAGPARSER_H_
+#define _TAGPARSER_H_
+
+#include <QByteArray>
+#include <QFile>
+#include <QString>
+
+#include "importer.h"
+
+/*
+ * Reads the tags and the length of MP3 (ID3v2 and ID3v1), FLAC, Ogg Vorbis and MP4 files from their headers
+ * alone, a few small reads at the start and the end of the file, where TagLib's FileRef parses the whole
+ * stream for its audio properties.  The fields are read the way TagLib reads them, so a track imports the same
+ * either way, and anything unusual (APE tags, unsynchronised or compressed frames, multiplexed streams, ...)
+ * is left to TagLib: read() returns false and the TagReader falls back to a FileRef.
+ */
+class TagParser
+{
+	public:
+		TagParser(const QString &);
+		
+		bool read(TrackInfo &);
+		static bool readTagLib(const QString &, TrackInfo &); //NOTE: with a FileRef, what the TagReader falls back to
+	
+	private:
+		bool readMpeg(TrackInfo &);
+		bool readFlac(TrackInfo &);
+		bool readOgg(TrackInfo &);
+		bool readMp4(TrackInfo &);
+		bool readId3v2(const QByteArray &, TrackInfo &); //NOTE: given the 10 byte header of the tag
+		void readId3v1(const QByteArray &, TrackInfo &);
+		bool readVorbisComment(const QByteArray &, TrackInfo &);
+		bool readAtom(qint64, qint64, QByteArray &, qint64 &, qint64 &);
+		bool findAtom(qint64, qint64, const char *, qint64 &, qint64 &);
+		QByteArray readAt(qint64, qint64);
+		
+		QFile file;
+		qint64 size;
+		QByteArray head; //NOTE: the start of the file, read once, most of the reads are served from it
+};
+
+#endif
@@ -0,0 +1,385 @@
+#include "importer.h"
+#include "tagparser.h"
+
+#include <QByteArray>
+#include <QCoreApplication>
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QPair>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+#include <KComponentData>
+
+/*
+ * projekt7-tagtest [files ...]
+ * Checks that TagParser reads what TagLib reads.  A small corpus of synthetic tracks is written to a scratch
+ * directory, one for each path through the parser, each is read by TagParser and by a FileRef and every field
+ * they disagree on is printed.  The files given on the command line are compared as well.  Exits with 1 on any
+ * mismatch, so it runs as a test.
+ */
+
+enum Expect {Parsed, LeftToTagLib, Either}; //NOTE: whether TagParser::read() should take the file, or leave it to TagLib
+
+struct Fixture {
+	QString name;
+	QByteArray data;
+	Expect expect;
+};
+
+const int MPEG_FRAME = 417; //NOTE: MPEG-1 layer III at 128 kbps and 44.1 kHz, unpadded
+const int COVER_SIZE = 20000; //NOTE: larger than the head TagParser reads, so the frames after it are seeked to
+
+static QByteArray bigEndian(quint64 value, int bytes) {
+	QByteArray data(bytes, 0);
+	for (int i = bytes - 1; i >= 0; --i, value >>= 8)
+		data[i] = (char)(value & 0xFF);
+	return data;
+}
+
+static QByteArray littleEndian(quint64 value, int bytes) {
+	QByteArray data(bytes, 0);
+	for (int i = 0; i < bytes; ++i, value >>= 8)
+		data[i] = (char)(value & 0xFF);
+	return data;
+}
+
+static QByteArray syncsafe(quint32 value) {
+	QByteArray data(4, 0);
+	for (int i = 3; i >= 0; --i, value >>= 7)
+		data[i] = (char)(value & 0x7F);
+	return data;
+}
+
+static QByteArray utf16(const QString &text) { //NOTE: little endian with a byte order mark, as most taggers write it
+	QByteArray data("\xFF\xFE", 2);
+	for (int i = 0; i < text.length(); ++i)
+		data += littleEndian(text.at(i).unicode(), 2);
+	return data;
+}
+
+static QByteArray cover() {
+	QByteArray image("\xFF\xD8\xFF\xE0", 4);
+	image += QByteArray(COVER_SIZE, '\x55');
+	return image;
+}
+
+static QByteArray id3Frame(int major, const QByteArray &id, const QByteArray &body) {
+	if (major == 2)
+		return id + bigEndian(body.size(), 3) + body;
+	return id + (major == 4 ? syncsafe(body.size()) : bigEndian(body.size(), 4)) + QByteArray(2, 0) + body;
+}
+
+//NOTE: `text` is already encoded, values separated by the encoding's null
+static QByteArray id3Text(int major, const QByteArray &id, int encoding, const QByteArray &text) {
+	return id3Frame(major, id, QByteArray(1, (char)encoding) + text);
+}
+
+static QByteArray id3Picture(int major) {
+	QByteArray body(1, 0); //NOTE: latin-1 description
+	body += major == 2 ? QByteArray("JPG") : QByteArray("image/jpeg", 11);
+	body += '\x03'; //NOTE: the front cover
+	body += QByteArray(1, 0);
+	body += cover();
+	return id3Frame(major, major == 2 ? "PIC" : "APIC", body);
+}
+
+static QByteArray id3v2(int major, const QByteArray &frames) {
+	QByteArray padding(256, 0);
+	return QByteArray("ID3") + (char)major + QByteArray(2, 0) + syncsafe(frames.size() + padding.size()) + frames + padding;
+}
+
+static QByteArray id3v1(const QByteArray &title, const QByteArray &artist, const QByteArray &album, const QByteArray &year, int track_number) {
+	QByteArray tag("TAG");
+	tag += title.leftJustified(30, 0, true) + artist.leftJustified(30, 0, true) + album.leftJustified(30, 0, true);
+	tag += year.leftJustified(4, 0, true);
+	tag += QByteArray(28, 0) + (char)0 + (char)track_number; //NOTE: ID3v1.1, the track number ends the comment
+	tag += (char)255; //NOTE: no genre
+	return tag;
+}
+
+//NOTE: joint stereo, the Xing or VBRI header sits 32 bytes of side information after the frame header
+static QByteArray mpegFrames(int num_frames, const QByteArray &vbr_header = QByteArray()) {
+	QByteArray frame("\xFF\xFB\x90\x44", 4);
+	frame += QByteArray(MPEG_FRAME - frame.size(), 0);
+	QByteArray first = frame;
+	first.replace(36, vbr_header.size(), vbr_header);
+	QByteArray stream = first;
+	for (int i = 1; i < num_frames; ++i)
+		stream += frame;
+	return stream;
+}
+
+static QByteArray xing(quint32 num_frames, quint32 bytes) {
+	return QByteArray("Xing") + bigEndian(3, 4) + bigEndian(num_frames, 4) + bigEndian(bytes, 4); //NOTE: the frame and byte counts are present
+}
+
+static QByteArray vbri(quint32 num_frames, quint32 bytes) {
+	QByteArray header = QByteArray("VBRI") + bigEndian(1, 2) + bigEndian(0, 2) + bigEndian(75, 2) + bigEndian(bytes, 4) + bigEndian(num_frames, 4);
+	return header + bigEndian(0, 2) + bigEndian(1, 2) + bigEndian(2, 2) + bigEndian(0, 2); //NOTE: an empty seek table
+}
+
+static QByteArray apeTag(const QList<QPair<QByteArray, QByteArray> > &items) {
+	QByteArray body;
+	for (int i = 0; i < items.count(); ++i)
+		body += littleEndian(items.at(i).second.size(), 4) + littleEndian(0, 4) + items.at(i).first + '\0' + items.at(i).second;
+	QByteArray footer = QByteArray("APETAGEX") + littleEndian(2000, 4) + littleEndian(body.size() + 32, 4) + littleEndian(items.count(), 4);
+	footer += littleEndian(0, 4) + QByteArray(8, 0); //NOTE: a footer without a header
+	return body + footer;
+}
+
+static QByteArray vorbisComment(const QStringList &fields) {
+	QByteArray vendor("projekt7-tagtest");
+	QByteArray comment = littleEndian(vendor.size(), 4) + vendor + littleEndian(fields.count(), 4);
+	for (int i = 0; i < fields.count(); ++i) {
+		QByteArray field = fields.at(i).toUtf8();
+		comment += littleEndian(field.size(), 4) + field;
+	}
+	return comment;
+}
+
+static QByteArray flacBlock(int type, const QByteArray &block, bool last = false) {
+	return QByteArray(1, (char)(type | (last ? 0x80 : 0))) + bigEndian(block.size(), 3) + block;
+}
+
+static QByteArray flac(quint64 samples, const QStringList &fields) {
+	QByteArray info = bigEndian(4096, 2) + bigEndian(4096, 2) + bigEndian(0, 3) + bigEndian(0, 3);
+	info += bigEndian((quint64)44100 << 44 | (quint64)1 << 41 | (quint64)15 << 36 | samples, 8); //NOTE: rate, channels - 1, bits - 1, samples
+	info += QByteArray(16, 0); //NOTE: no MD5 of the audio
+	QByteArray picture = bigEndian(3, 4) + bigEndian(10, 4) + "image/jpeg" + bigEndian(0, 4);
+	picture += bigEndian(500, 4) + bigEndian(500, 4) + bigEndian(24, 4) + bigEndian(0, 4);
+	picture += bigEndian(cover().size(), 4) + cover();
+	QByteArray stream("fLaC");
+	stream += flacBlock(0, info) + flacBlock(6, picture) + flacBlock(4, vorbisComment(fields)) + flacBlock(1, QByteArray(1024, 0), true);
+	stream += QByteArray("\xFF\xF8", 2) + QByteArray(2046, 0); //NOTE: no real frames, TagLib only reads STREAMINFO
+	return stream;
+}
+
+//NOTE: each packet starts a page, one longer than 16 segments continues on the next, about the 4 KB pages libvorbis writes
+static QByteArray oggPages(const QByteArray &packet, quint32 serial, quint32 &sequence, qint64 granule, int flags) {
+	QByteArray pages;
+	int position = 0;
+	bool continued = false;
+	do {
+		QByteArray segments, body;
+		while (segments.size() < 16 && position <= packet.size()) {
+			int length = qMin(255, packet.size() - position);
+			segments += (char)length;
+			body += packet.mid(position, length);
+			position += length;
+			if (length < 255) {
+				++position; //NOTE: past the end, the packet is done
+				break;
+			}
+		}
+		bool done = position > packet.size();
+		QByteArray header("OggS");
+		header += (char)0;
+		header += (char)(flags | (continued ? 1 : 0));
+		header += littleEndian(done ? granule : (quint64)-1, 8) + littleEndian(serial, 4) + littleEndian(sequence++, 4);
+		header += littleEndian(0, 4); //NOTE: no CRC, neither reader checks it
+		header += (char)segments.size();
+		pages += header + segments + body;
+		continued = !done;
+		flags = 0;
+	} while (position <= packet.size());
+	return pages;
+}
+
+static QByteArray ogg(quint64 samples, const QStringList &fields) {
+	QByteArray info("\x01vorbis");
+	info += littleEndian(0, 4) + (char)2 + littleEndian(44100, 4) + littleEndian(0, 4) + littleEndian(128000, 4) + littleEndian(0, 4);
+	info += (char)0xB8;
+	info += (char)1;
+	QByteArray comment = QByteArray("\x03vorbis") + vorbisComment(fields) + (char)1;
+	quint32 serial = 0x7A7A, sequence = 0;
+	QByteArray stream = oggPages(info, serial, sequence, 0, 2);
+	stream += oggPages(comment, serial, sequence, 0, 0);
+	stream += oggPages(QByteArray("\x05vorbis") + QByteArray(64, 0), serial, sequence, 0, 0);
+	stream += oggPages(QByteArray(1000, 0), serial, sequence, samples / 2, 0);
+	stream += oggPages(QByteArray(1000, 0), serial, sequence, samples, 4);
+	return stream;
+}
+
+static QByteArray atom(const QByteArray &type, const QByteArray &body) {
+	return bigEndian(body.size() + 8, 4) + type + body;
+}
+
+static QByteArray fullAtom(const QByteArray &type, const QByteArray &body) { //NOTE: with a version and flags
+	return atom(type, QByteArray(4, 0) + body);
+}
+
+static QByteArray mp4Item(const QByteArray &type, const QList<QByteArray> &values, int data_type = 1) {
+	QByteArray body;
+	for (int i = 0; i < values.count(); ++i)
+		body += atom("data", bigEndian(data_type, 4) + QByteArray(4, 0) + values.at(i));
+	return atom(type, body);
+}
+
+static QByteArray mp4Track(const QByteArray &handler, quint32 timescale, quint32 duration) {
+	QByteArray mdhd = fullAtom("mdhd", bigEndian(0, 4) + bigEndian(0, 4) + bigEndian(timescale, 4) + bigEndian(duration, 4) + bigEndian(0, 4));
+	QByteArray hdlr = fullAtom("hdlr", bigEndian(0, 4) + handler + QByteArray(12, 0) + '\0');
+	return atom("trak", atom("mdia", mdhd + hdlr));
+}
+
+static QByteArray mp4(const QByteArray &ilst) {
+	QByteArray stream = atom("ftyp", QByteArray("M4A ") + bigEndian(0, 4) + "M4A mp42isom");
+	QByteArray media(10000, 0);
+	stream += bigEndian(1, 4) + "mdat" + bigEndian(media.size() + 16, 8) + media; //NOTE: with a 64 bit size
+	QByteArray mvhd = fullAtom("mvhd", bigEndian(0, 4) + bigEndian(0, 4) + bigEndian(1000, 4) + bigEndian(241000, 4) + QByteArray(80, 0));
+	QByteArray meta = fullAtom("meta", fullAtom("hdlr", bigEndian(0, 4) + "mdir" + "appl" + QByteArray(8, 0) + '\0') + atom("ilst", ilst));
+	stream += atom("moov", mvhd + mp4Track("vide", 600, 600 * 30) + mp4Track("soun", 44100, 44100 * 241) + atom("udta", meta));
+	return stream;
+}
+
+static QList<Fixture> corpus() {
+	QList<Fixture> fixtures;
+	Fixture fixture;
+	QByteArray frames;
+	
+	frames = id3Text(4, "TPE1", 3, QString::fromUtf8("Sigur Rós").toUtf8() + '\0' + "Amiina");
+	frames += id3Picture(4);
+	frames += id3Text(4, "TALB", 3, QString::fromUtf8("Ágætis byrjun").toUtf8());
+	frames += id3Text(4, "TIT2", 3, "Svefn-g-englar");
+	frames += id3Text(4, "TDRC", 3, "1999-06-12");
+	frames += id3Text(4, "TRCK", 3, "2/10");
+	fixture.name = "id3v24-apic-xing.mp3";
+	fixture.data = id3v2(4, frames) + mpegFrames(20, xing(1000, 1000 * MPEG_FRAME)); //NOTE: the Xing header's 26 seconds, not the 0 the stream gives
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	frames = id3Text(3, "TPE1", 0, "Boards of Canada");
+	frames += id3Text(3, "TALB", 0, "Music Has the Right to Children");
+	frames += id3Picture(3);
+	frames += id3Text(3, "TIT2", 0, "Roygbiv");
+	frames += id3Text(3, "TYER", 0, "1998");
+	frames += id3Text(3, "TRCK", 0, "9");
+	fixture.name = "id3v23-apic-vbri.mp3";
+	fixture.data = id3v2(3, frames) + mpegFrames(20, vbri(2300, 2300 * MPEG_FRAME));
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	frames = id3Picture(2);
+	frames += id3Text(2, "TP1", 0, "Autechre");
+	frames += id3Text(2, "TAL", 0, "Tri Repetae");
+	frames += id3Text(2, "TT2", 0, "Clipper");
+	frames += id3Text(2, "TYE", 0, "1995");
+	frames += id3Text(2, "TRK", 0, "3");
+	fixture.name = "id3v22-pic-cbr.mp3";
+	fixture.data = id3v2(2, frames) + mpegFrames(150); //NOTE: 3.9 seconds from the stream length and bitrate
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	frames = id3Text(3, "TPE1", 1, utf16(QString::fromUtf8("Björk")));
+	frames += id3Text(3, "TIT2", 1, utf16(QString::fromUtf8("Jóga")));
+	frames += id3Text(3, "TYER", 0, "1997");
+	fixture.name = "id3v23-utf16-id3v1.mp3";
+	fixture.data = id3v2(3, frames) + QByteArray(4, 0) + mpegFrames(150) + id3v1("Joga", "Bjork", "Homogenic", "1996", 2); //NOTE: the album and track number only come from ID3v1
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	QList<QPair<QByteArray, QByteArray> > items;
+	items << qMakePair(QByteArray("Artist"), QByteArray("Aphex Twin")) << qMakePair(QByteArray("Album"), QByteArray("Drukqs"));
+	items << qMakePair(QByteArray("Title"), QByteArray("Avril 14th")) << qMakePair(QByteArray("Year"), QByteArray("2001")) << qMakePair(QByteArray("Track"), QByteArray("4"));
+	fixture.name = "ape.mp3";
+	fixture.data = mpegFrames(150) + apeTag(items);
+	fixture.expect = LeftToTagLib;
+	fixtures << fixture;
+	
+	fixture.name = "picture.flac";
+	fixture.data = flac(44100 * 187 + 100, QStringList() << "ARTIST=Stars of the Lid" << "ARTIST=Brian McBride" << "ALBUM=The Tired Sounds of" << "TITLE=Requiem for Dying Mothers" << "DATE=2001" << "TRACKNUMBER=1/16");
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	QStringList fields;
+	fields << "ARTIST=Godspeed You! Black Emperor" << "ALBUM=Lift Your Skinny Fists Like Antennas to Heaven" << "TITLE=Storm" << "YEAR=2000" << "TRACKNUM=1";
+	fields << "COMMENT=" + QString(10000, 'x'); //NOTE: the comment header runs over three pages
+	fixture.name = "pages.ogg";
+	fixture.data = ogg(44100 * 1347 + 5, fields);
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	QByteArray ilst = mp4Item("\251nam", QList<QByteArray>() << "Windowlicker");
+	ilst += mp4Item("covr", QList<QByteArray>() << cover(), 13);
+	ilst += mp4Item("\251ART", QList<QByteArray>() << "Aphex Twin" << "Richard D. James");
+	ilst += mp4Item("\251alb", QList<QByteArray>() << "Windowlicker");
+	ilst += mp4Item("\251day", QList<QByteArray>() << "1999-03-22T08:00:00Z");
+	ilst += mp4Item("trkn", QList<QByteArray>() << bigEndian(0, 2) + bigEndian(1, 2) + bigEndian(3, 2) + bigEndian(0, 2), 0);
+	fixture.name = "moov-after-mdat.m4a";
+	fixture.data = mp4(ilst);
+	fixture.expect = Parsed;
+	fixtures << fixture;
+	
+	return fixtures;
+}
+
+static bool compareField(QTextStream &out, const QString &path, const char *field, const QString &parsed, const QString &taglib) {
+	if (parsed == taglib)
+		return true;
+	out << path << ": " << field << " is \"" << parsed << "\", TagLib reads \"" << taglib << "\"" << endl;
+	return false;
+}
+
+static bool compare(QTextStream &out, const QString &path, Expect expect) {
+	TrackInfo parsed, taglib;
+	bool read = TagParser(path).read(parsed);
+	if (read && expect == LeftToTagLib) {
+		out << path << ": read, should be left to TagLib" << endl;
+		return false;
+	}
+	if (!read) {
+		if (expect == Parsed)
+			out << path << ": left to TagLib, should be read" << endl;
+		return expect != Parsed;
+	}
+	if (!TagParser::readTagLib(path, taglib)) {
+		out << path << ": read, TagLib can't read it" << endl;
+		return false;
+	}
+	bool same = compareField(out, path, "artist", parsed.artist, taglib.artist);
+	same &= compareField(out, path, "album", parsed.album, taglib.album);
+	same &= compareField(out, path, "title", parsed.title, taglib.title);
+	same &= compareField(out, path, "year", QString::number(parsed.year), QString::number(taglib.year));
+	same &= compareField(out, path, "track number", QString::number(parsed.track_number), QString::number(taglib.track_number));
+	same &= compareField(out, path, "length", QString::number(parsed.length), QString::number(taglib.length));
+	return same;
+}
+
+int main(int argc, char* argv[]) {
+	QCoreApplication app(argc, argv);
+	KComponentData component("projekt7-tagtest");
+	QTextStream out(stdout);
+	QDir scratch(QDir::temp().filePath(QString("projekt7-tagtest-%1").arg(QCoreApplication::applicationPid())));
+	if (!QDir().mkpath(scratch.path())) {
+		out << "can't create " << scratch.path() << endl;
+		return 1;
+	}
+	int checked = 0, failed = 0;
+	QList<Fixture> fixtures = corpus();
+	Fixture fixture;
+	foreach(fixture, fixtures) {
+		QString path = scratch.filePath(fixture.name);
+		QFile file(path);
+		if (!file.open(QIODevice::WriteOnly) || file.write(fixture.data) != fixture.data.size()) {
+			out << "can't write " << path << endl;
+			return 1;
+		}
+		file.close();
+		++checked;
+		if (!compare(out, path, fixture.expect))
+			++failed;
+		QFile::remove(path);
+	}
+	scratch.rmdir(scratch.path());
+	QStringList args = app.arguments().mid(1);
+	QString arg;
+	foreach(arg, args) {
+		++checked;
+		if (!compare(out, arg, Either))
+			++failed;
+	}
+	out << checked << " files, " << failed << " read differently" << endl;
+	return failed ? 1 : 0;
+}
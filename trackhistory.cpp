@@ -0,0 +1,66 @@
+#include "trackhistory.h"
+#include "profiler.h"
+
+TrackHistory::TrackHistory(DatabaseWorker *database, int depth) : database(database), depth(qMax(depth, 1)) {
+}
+
+bool TrackHistory::load(sqlite3 *db) {
+	ProfileSpan span("Failed to load the play history: ");
+	tids.clear();
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `tid` FROM `history` ORDER BY `position`", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW)
+		tids.push_back(sqlite3_column_int(stmt, 0));
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+void TrackHistory::restore(const TrackHistory &saved) {
+	QList<int> played = tids; //NOTE: already written behind the saved rows
+	tids = saved.tids + played;
+	trim();
+}
+
+void TrackHistory::setDepth(int new_depth) {
+	depth = qMax(new_depth, 1);
+	trim();
+}
+
+int TrackHistory::count() const {
+	return tids.count();
+}
+
+void TrackHistory::push(int tid) {
+	tids.push_back(tid);
+	if (database)
+		database->post(new ExecTask(sqlite3_mprintf("INSERT INTO `history` (`tid`) VALUES (%d)", tid), "Failed to write the play history: "));
+	trim();
+}
+
+int TrackHistory::pop() {
+	if (tids.isEmpty())
+		return 0;
+	if (database)
+		database->post(new ExecTask(sqlite3_mprintf("%s", "DELETE FROM `history` WHERE `position`=(SELECT MAX(`position`) FROM `history`)"), "Failed to write the play history: "));
+	return tids.takeLast();
+}
+
+void TrackHistory::retain(const LibraryIndex &library) {
+	QList<int>::iterator itt = tids.begin();
+	while (itt != tids.end()) {
+		if (library.contains(*itt))
+			++itt;
+		else
+			itt = tids.erase(itt);
+	}
+}
+
+void TrackHistory::trim() {
+	if (tids.count() <= depth)
+		return;
+	tids.erase(tids.begin(), tids.end() - depth);
+	if (database) //NOTE: by rows, not by `position`, deleted tracks leave gaps
+		database->post(new ExecTask(sqlite3_mprintf("DELETE FROM `history` WHERE `position`<(SELECT MIN(`position`) FROM (SELECT `position` FROM `history` ORDER BY `position` DESC LIMIT %d))", depth), "Failed to write the play history: "));
+}
@@ -0,0 +1,39 @@
+#ifndef _TRACKHISTORY_H_
+#define _TRACKHISTORY_H_
+
+#include <QList>
+
+#include <sqlite3.h>
+
+#include "databaseworker.h"
+#include "libraryindex.h"
+
+/*
+ * The tracks played, a stack of `tid`s with the playing track on top, kept to a configurable depth.  It is
+ * loaded with the library at startup and written behind to the `history` table like the TrackQueue.  A
+ * deleted track is dropped by a trigger in the database and by one retain() pass over the stack when the
+ * library is reloaded, so pop() never has to skip over tracks that are gone.
+ */
+class TrackHistory
+{
+	public:
+		TrackHistory(DatabaseWorker * = 0, int = 100);
+		
+		bool load(sqlite3 *);
+		void restore(const TrackHistory &); //NOTE: takes over a loaded history, keeping what was played while it loaded
+		void setDepth(int);
+		
+		int count() const;
+		void push(int);
+		int pop(); //NOTE: the `tid` that was on top, 0 when empty
+		void retain(const LibraryIndex &);
+	
+	private:
+		void trim();
+		
+		DatabaseWorker *database;
+		QList<int> tids; //NOTE: the latest last
+		int depth;
+};
+
+#endif
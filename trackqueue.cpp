@@ -0,0 +1,135 @@
+#include "trackqueue.h"
+#include "profiler.h"
+
+/*
+ * Adds tracks to the end of the `queue` table, or replaces the whole table when the queue was reordered.
+ */
+class QueueWriteTask : public DatabaseTask
+{
+	public:
+		QueueWriteTask(const QList<int> &, bool);
+		
+		bool run(sqlite3 *);
+	
+	private:
+		QList<int> tids;
+		bool replace;
+};
+
+QueueWriteTask::QueueWriteTask(const QList<int> &tids, bool replace) : DatabaseTask("Failed to write the track queue: "), tids(tids), replace(replace) {
+}
+
+bool QueueWriteTask::run(sqlite3 *db) {
+	ProfileSpan span(failure_msg);
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "INSERT OR IGNORE INTO `queue` (`tid`) VALUES (?)", -1, &stmt, 0)) //NOTE: a new `position` is one past the last
+		return false;
+	if (!exec(db, "BEGIN")) {
+		sqlite3_finalize(stmt);
+		return false;
+	}
+	int return_code = replace && !exec(db, "DELETE FROM `queue`") ? SQLITE_ERROR : SQLITE_DONE;
+	for (int i = 0; i < tids.count() && return_code == SQLITE_DONE; ++i) {
+		sqlite3_bind_int(stmt, 1, tids.at(i));
+		return_code = sqlite3_step(stmt);
+		sqlite3_reset(stmt);
+	}
+	sqlite3_finalize(stmt);
+	if (return_code != SQLITE_DONE) {
+		exec(db, "ROLLBACK");
+		return false;
+	}
+	return exec(db, "COMMIT");
+}
+
+TrackQueue::TrackQueue(DatabaseWorker *database) : database(database) {
+}
+
+bool TrackQueue::load(sqlite3 *db) {
+	ProfileSpan span("Failed to load the track queue: ");
+	queue.clear();
+	members.clear();
+	sqlite3_stmt *stmt = 0;
+	if (sqlite3_prepare_v2(db, "SELECT `tid` FROM `queue` ORDER BY `position`", -1, &stmt, 0))
+		return false;
+	int return_code;
+	while ((return_code = sqlite3_step(stmt)) == SQLITE_ROW) {
+		int tid = sqlite3_column_int(stmt, 0);
+		queue.push_back(tid);
+		members.insert(tid);
+	}
+	sqlite3_finalize(stmt);
+	return return_code == SQLITE_DONE;
+}
+
+void TrackQueue::restore(const TrackQueue &saved) {
+	QList<int> queued = queue; //NOTE: already written behind the saved rows, in this order
+	queue = saved.queue;
+	members = saved.members;
+	int tid;
+	foreach(tid, queued) {
+		if (!members.contains(tid)) {
+			queue.push_back(tid);
+			members.insert(tid);
+		}
+	}
+}
+
+int TrackQueue::count() const {
+	return queue.count();
+}
+
+int TrackQueue::at(int index) const {
+	return queue.at(index);
+}
+
+bool TrackQueue::contains(int tid) const {
+	return members.contains(tid);
+}
+
+const QList<int> &TrackQueue::tids() const {
+	return queue;
+}
+
+int TrackQueue::append(const QList<int> &tids) {
+	QList<int> added;
+	int tid;
+	foreach(tid, tids) {
+		if (!members.contains(tid)) {
+			queue.push_back(tid);
+			members.insert(tid);
+			added.push_back(tid);
+		}
+	}
+	if (database && !added.isEmpty())
+		database->post(new QueueWriteTask(added, false));
+	return added.count();
+}
+
+void TrackQueue::remove(int tid) {
+	if (!members.remove(tid))
+		return;
+	queue.removeOne(tid); //NOTE: a played track is the first one, so this rarely walks
+	if (database)
+		database->post(new ExecTask(sqlite3_mprintf("DELETE FROM `queue` WHERE `tid`=%d", tid), "Failed to dequeue a track: "));
+}
+
+void TrackQueue::move(int from, int to) {
+	if (from == to)
+		return;
+	queue.move(from, to);
+	if (database)
+		database->post(new QueueWriteTask(queue, true)); //NOTE: only the queue editor reorders, the queue is rewritten in its new order
+}
+
+void TrackQueue::retain(const LibraryIndex &library) {
+	QList<int>::iterator itt = queue.begin();
+	while (itt != queue.end()) {
+		if (library.contains(*itt))
+			++itt;
+		else {
+			members.remove(*itt);
+			itt = queue.erase(itt);
+		}
+	}
+}
@@ -0,0 +1,42 @@
+#ifndef _TRACKQUEUE_H_
+#define _TRACKQUEUE_H_
+
+#include <QList>
+#include <QSet>
+
+#include <sqlite3.h>
+
+#include "databaseworker.h"
+#include "libraryindex.h"
+
+/*
+ * The tracks queued to play next, in order, with a set of the same `tid`s so the titles column can ask
+ * whether each row is queued without walking the queue.  Like the ShuffleBag it is loaded on the
+ * DatabaseWorker thread and changed in memory, every change is written behind to the `queue` table, so the
+ * queue survives a restart.  A track is queued at most once, `queue`.`tid` is UNIQUE to match.
+ */
+class TrackQueue
+{
+	public:
+		TrackQueue(DatabaseWorker * = 0);
+		
+		bool load(sqlite3 *);
+		void restore(const TrackQueue &); //NOTE: takes over a loaded queue, keeping what was queued while it loaded
+		
+		int count() const;
+		int at(int) const;
+		bool contains(int) const;
+		const QList<int> &tids() const;
+		
+		int append(const QList<int> &); //NOTE: one transaction however many tracks, returns how many weren't queued yet
+		void remove(int);
+		void move(int, int);
+		void retain(const LibraryIndex &); //NOTE: drops deleted tracks, the database has already dropped them
+	
+	private:
+		DatabaseWorker *database;
+		QList<int> queue;
+		QSet<int> members;
+};
+
+#endif
@@ -0,0 +1,141 @@
+#include "trackwriter.h"
+#include "profiler.h"
+
+#include <string>
+
+TrackWriter::TrackWriter(sqlite3 *db, int batch_size) : db(db), insert_stmt(0), update_stmt(0), remove_stmt(0), length_stmt(0), plays_stmt(0), batch_size(qMax(batch_size, 1)), pending(0), num_inserted(0), num_updated(0), num_removed(0), failed(false) {
+	const char *insert_query = "INSERT INTO `tracks` (`artist`, `year`, `album`, `track_number`, `title`, `length`, `size`, `mtime`, `path`) VALUES (?, ?, ?, ?, ?, ?, ?, ?, ?)";
+	const char *update_query = "UPDATE `tracks` SET `artist`=?, `year`=?, `album`=?, `track_number`=?, `title`=?, `length`=?, `size`=?, `mtime`=? WHERE `path`=?";
+	const char *remove_query = "DELETE FROM `tracks` WHERE `path`=?";
+	const char *plays_query = "UPDATE `tracks` SET `playcount`=IFNULL(`playcount`, 0) + ? WHERE `tid`=?";
+	const char *length_query = "UPDATE `tracks` SET `length`=? WHERE `tid`=? AND `length` IS NULL"; //NOTE: a re-import may have read the length in the meantime
+	if (sqlite3_prepare_v2(db, insert_query, -1, &insert_stmt, 0) || sqlite3_prepare_v2(db, update_query, -1, &update_stmt, 0) || sqlite3_prepare_v2(db, remove_query, -1, &remove_stmt, 0) || sqlite3_prepare_v2(db, length_query, -1, &length_stmt, 0) || sqlite3_prepare_v2(db, plays_query, -1, &plays_stmt, 0))
+		failed = true;
+}
+
+TrackWriter::~TrackWriter() {
+	commit();
+	sqlite3_finalize(insert_stmt);
+	sqlite3_finalize(update_stmt);
+	sqlite3_finalize(remove_stmt);
+	sqlite3_finalize(length_stmt);
+	sqlite3_finalize(plays_stmt);
+}
+
+bool TrackWriter::write(const TrackInfo &track) {
+	ProfileSpan span("Failed to insert tracks: ");
+	if (!begin())
+		return false;
+	bindTrack(update_stmt, track); //NOTE: the UPDATE is a lookup on the unique `path` index, so trying it first is cheap for new tracks too
+	if (!run(update_stmt))
+		return false;
+	if (sqlite3_changes(db) > 0)
+		++num_updated;
+	else {
+		bindTrack(insert_stmt, track);
+		if (!run(insert_stmt))
+			return false;
+		++num_inserted;
+	}
+	if (++pending >= batch_size)
+		return commit();
+	return true;
+}
+
+bool TrackWriter::remove(const QString &path) {
+	ProfileSpan span("Failed to remove tracks: ");
+	if (!begin())
+		return false;
+	bindText(remove_stmt, 1, path);
+	if (!run(remove_stmt))
+		return false;
+	num_removed += sqlite3_changes(db);
+	if (++pending >= batch_size)
+		return commit();
+	return true;
+}
+
+bool TrackWriter::writeLength(int tid, int length) {
+	if (!begin())
+		return false;
+	sqlite3_bind_int(length_stmt, 1, length);
+	sqlite3_bind_int(length_stmt, 2, tid);
+	if (!run(length_stmt))
+		return false;
+	if (++pending >= batch_size)
+		return commit();
+	return true;
+}
+
+bool TrackWriter::addPlays(int tid, int plays) {
+	if (!begin())
+		return false;
+	sqlite3_bind_int(plays_stmt, 1, plays);
+	sqlite3_bind_int(plays_stmt, 2, tid);
+	if (!run(plays_stmt))
+		return false;
+	if (++pending >= batch_size)
+		return commit();
+	return true;
+}
+
+bool TrackWriter::commit() {
+	if (pending == 0)
+		return !failed;
+	pending = 0;
+	ProfileSpan span("Failed to commit tracks: ");
+	return exec("COMMIT");
+}
+
+const char *TrackWriter::errorMessage() {
+	return sqlite3_errmsg(db);
+}
+
+int TrackWriter::inserted() {
+	return num_inserted;
+}
+
+int TrackWriter::updated() {
+	return num_updated;
+}
+
+int TrackWriter::removed() {
+	return num_removed;
+}
+
+bool TrackWriter::begin() {
+	if (failed)
+		return false;
+	return pending > 0 || exec("BEGIN");
+}
+
+bool TrackWriter::run(sqlite3_stmt *stmt) {
+	int return_code = sqlite3_step(stmt);
+	sqlite3_reset(stmt);
+	if (return_code != SQLITE_DONE)
+		failed = true;
+	return !failed;
+}
+
+bool TrackWriter::exec(const char *query) {
+	if (sqlite3_exec(db, query, 0, 0, 0))
+		failed = true;
+	return !failed;
+}
+
+void TrackWriter::bindText(sqlite3_stmt *stmt, int index, const QString &text) {
+	std::string bytes = text.toStdString(); //NOTE: same conversion as qtos, so the stored text matches the text used in the browse queries
+	sqlite3_bind_text(stmt, index, bytes.c_str(), bytes.size(), SQLITE_TRANSIENT);
+}
+
+void TrackWriter::bindTrack(sqlite3_stmt *stmt, const TrackInfo &track) {
+	bindText(stmt, 1, track.artist);
+	sqlite3_bind_int(stmt, 2, track.year);
+	bindText(stmt, 3, track.album);
+	sqlite3_bind_int(stmt, 4, track.track_number);
+	bindText(stmt, 5, track.title);
+	sqlite3_bind_int(stmt, 6, track.length);
+	sqlite3_bind_int64(stmt, 7, track.stamp.size);
+	sqlite3_bind_int64(stmt, 8, track.stamp.mtime);
+	bindText(stmt, 9, track.path);
+}
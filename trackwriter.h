@@ -0,0 +1,44 @@
+#ifndef _TRACKWRITER_H_
+#define _TRACKWRITER_H_
+
+#include <QString>
+
+#include <sqlite3.h>
+
+#include "importer.h"
+
+/*
+ * Bulk write path for imports: prepared statements are bound and reused for every track and rows are
+ * committed in batches, instead of re-parsing SQL and paying for an autocommit transaction per file.
+ * A track whose path is already in the library is updated in place, so it keeps its `tid`.
+ */
+class TrackWriter
+{
+	public:
+		TrackWriter(sqlite3 *, int = 500);
+		~TrackWriter();
+		
+		bool write(const TrackInfo &);
+		bool remove(const QString &);
+		bool writeLength(int, int);
+		bool addPlays(int, int);
+		bool commit();
+		const char *errorMessage();
+		int inserted();
+		int updated();
+		int removed();
+		
+	private:
+		bool begin();
+		bool run(sqlite3_stmt *);
+		bool exec(const char *);
+		void bindText(sqlite3_stmt *, int, const QString &);
+		void bindTrack(sqlite3_stmt *, const TrackInfo &);
+		
+		sqlite3 *db;
+		sqlite3_stmt *insert_stmt, *update_stmt, *remove_stmt, *length_stmt, *plays_stmt;
+		int batch_size, pending, num_inserted, num_updated, num_removed;
+		bool failed;
+};
+
+#endif